@@ -5,16 +5,22 @@
 // #include "vec3.hpp"
 // #include "ray.hpp"
 
-class aabb{
+// An axis-aligned box of scalar type T; the renderer uses aabb = aabb_t<real>.
+template <typename T>
+class aabb_t{
   public :
+    using interval = interval_t<T>;
+    using point3 = vec3_t<T>;
+    using ray = ray_t<T>;
+
     interval x, y, z;
-    aabb(){} ;
-    aabb(const interval& x , const interval& y , const interval& z) 
+    aabb_t(){} ;
+    aabb_t(const interval& x , const interval& y , const interval& z) 
     :x(x), y(y), z(z)
     {
         pad_to_minimums();
     } ;
-    aabb(const point3& a, const point3 b){
+    aabb_t(const point3& a, const point3 b){
         // Treat the two points a and b as extrema for the bounding box, so we don't require a
         // particular minimum/maximum coordinate order.
         x = (a[0] < b[0]) ? interval(a[0], b[0]) : interval(b[0], a[0]);
@@ -23,7 +29,7 @@ class aabb{
         pad_to_minimums();
     }
 
-   aabb(const aabb& box0, const aabb& box1) {
+   aabb_t(const aabb_t& box0, const aabb_t& box1) {
         x = interval(box0.x, box1.x);
         y = interval(box0.y, box1.y);
         z = interval(box0.z, box1.z);
@@ -37,13 +43,13 @@ class aabb{
 
     bool hit (const ray& r , interval ray_t) const {
         const point3 ray_orig = r.origin();
-        const vec3& ray_dir = r.direction();
+        const point3& ray_dir = r.direction();
         for (int axis = 0 ; axis < 3 ; axis ++){
             const interval& ax = axis_interval(axis);
-            const double adinv = 1.0 / ray_dir[axis];// 如果是 0 ?
+            const T adinv = T(1.0) / ray_dir[axis];// 如果是 0 ?
 
-            double t0 = (ax.min - ray_orig[axis]) * adinv;
-            double t1 = (ax.max - ray_orig[axis]) * adinv;
+            T t0 = (ax.min - ray_orig[axis]) * adinv;
+            T t1 = (ax.max - ray_orig[axis]) * adinv;
             if (t0 < t1 ){
                 if (t0 > ray_t.min ) ray_t.min = t0;
                 if (t1 < ray_t.max ) ray_t.max = t1;
@@ -68,27 +74,36 @@ class aabb{
     }
     
     void pad_to_minimums(){
-        // Adjust the AABB so that no side is narrower than some delta, padding if necessary.
-        double delta = 0.0001;
-        if (x.size() < delta) x.expand(delta);
-        if (y.size() < delta) y.expand(delta);
-        if (z.size() < delta) z.expand(delta);
+        // Adjust the AABB so that no side is narrower than some delta, padding if necessary. The
+        // delta grows with the box's coordinates so that, in single precision too, the padded
+        // sides are still apart after rounding.
+        for (interval* side : { &x, &y, &z }) {
+            T size = std::fmax(std::fabs(side->min), std::fabs(side->max));
+            T delta = std::fmax(T(0.0001), 16 * std::numeric_limits<T>::epsilon() * size);
+            if (side->min <= side->max && side->size() < delta) *side = side->expand(delta);
+        }
     }
 
 
 
 
-    static const aabb empty, universe;
+    static const aabb_t empty, universe;
 };
 
-const aabb aabb::empty    = aabb(interval::empty,    interval::empty,    interval::empty);
-const aabb aabb::universe = aabb(interval::universe, interval::universe, interval::universe);
+template <typename T>
+const aabb_t<T> aabb_t<T>::empty    = aabb_t<T>(interval_t<T>::empty,    interval_t<T>::empty,    interval_t<T>::empty);
+template <typename T>
+const aabb_t<T> aabb_t<T>::universe = aabb_t<T>(interval_t<T>::universe, interval_t<T>::universe, interval_t<T>::universe);
+
+using aabb = aabb_t<real>;
 
-aabb operator+(const aabb& bbox, const vec3& offset) {
-    return aabb(bbox.x + offset.x(), bbox.y + offset.y(), bbox.z + offset.z());
+template <typename T>
+aabb_t<T> operator+(const aabb_t<T>& bbox, const vec3_t<T>& offset) {
+    return aabb_t<T>(bbox.x + offset.x(), bbox.y + offset.y(), bbox.z + offset.z());
 };
 
-aabb operator+(const vec3& offset, const aabb& bbox) {
+template <typename T>
+aabb_t<T> operator+(const vec3_t<T>& offset, const aabb_t<T>& bbox) {
     return bbox + offset;
 };
 
@@ -0,0 +1,136 @@
+#ifndef AFFINE_H
+#define AFFINE_H
+
+#include "utilis.hpp"
+#include "aabb.hpp"
+
+// A 3x4 affine transform: a 3x3 linear part followed by a translation. The implicit fourth row is
+// (0, 0, 0, 1), so points pick up the translation and direction vectors do not.
+class affine {
+  public:
+    real m[3][4];
+
+    affine() : m{{1,0,0,0}, {0,1,0,0}, {0,0,1,0}} {}
+
+    static affine translation(const vec3& offset) {
+        affine a;
+        a.m[0][3] = offset.x();
+        a.m[1][3] = offset.y();
+        a.m[2][3] = offset.z();
+        return a;
+    }
+
+    static affine scaling(const vec3& s) {
+        affine a;
+        a.m[0][0] = s.x();
+        a.m[1][1] = s.y();
+        a.m[2][2] = s.z();
+        return a;
+    }
+
+    static affine rotation(const vec3& axis, double angle) {
+        // Rotation by `angle` degrees about `axis`, counter-clockwise when looking down the axis
+        // (Rodrigues' formula).
+        auto k = unit_vector(axis);
+        auto radians = degrees_to_radians(angle);
+        auto c = std::cos(radians), s = std::sin(radians), t = 1 - c;
+
+        affine a;
+        a.m[0][0] = t*k.x()*k.x() + c;       a.m[0][1] = t*k.x()*k.y() - s*k.z();
+        a.m[0][2] = t*k.x()*k.z() + s*k.y();
+        a.m[1][0] = t*k.x()*k.y() + s*k.z(); a.m[1][1] = t*k.y()*k.y() + c;
+        a.m[1][2] = t*k.y()*k.z() - s*k.x();
+        a.m[2][0] = t*k.x()*k.z() - s*k.y(); a.m[2][1] = t*k.y()*k.z() + s*k.x();
+        a.m[2][2] = t*k.z()*k.z() + c;
+        return a;
+    }
+
+    point3 transform_point(const point3& p) const {
+        return point3(m[0][0]*p.x() + m[0][1]*p.y() + m[0][2]*p.z() + m[0][3],
+                      m[1][0]*p.x() + m[1][1]*p.y() + m[1][2]*p.z() + m[1][3],
+                      m[2][0]*p.x() + m[2][1]*p.y() + m[2][2]*p.z() + m[2][3]);
+    }
+
+    vec3 transform_vector(const vec3& v) const {
+        return vec3(m[0][0]*v.x() + m[0][1]*v.y() + m[0][2]*v.z(),
+                    m[1][0]*v.x() + m[1][1]*v.y() + m[1][2]*v.z(),
+                    m[2][0]*v.x() + m[2][1]*v.y() + m[2][2]*v.z());
+    }
+
+    vec3 transform_transposed(const vec3& v) const {
+        // Multiplies v by the transpose of the linear part. Called on the inverse transform, this
+        // maps object-space normals to world space.
+        return vec3(m[0][0]*v.x() + m[1][0]*v.y() + m[2][0]*v.z(),
+                    m[0][1]*v.x() + m[1][1]*v.y() + m[2][1]*v.z(),
+                    m[0][2]*v.x() + m[1][2]*v.y() + m[2][2]*v.z());
+    }
+
+    ray transform_ray(const ray& r) const {
+        // The direction is not renormalised, so hit distances t are the same in both spaces.
+        return ray(transform_point(r.origin()), transform_vector(r.direction()), r.time());
+    }
+
+    aabb transform_box(const aabb& box) const {
+        // Bounds of the eight transformed corners.
+        point3 min( infinity,  infinity,  infinity);
+        point3 max(-infinity, -infinity, -infinity);
+
+        for (int i = 0; i < 2; i++) {
+            for (int j = 0; j < 2; j++) {
+                for (int k = 0; k < 2; k++) {
+                    auto x = i ? box.x.max : box.x.min;
+                    auto y = j ? box.y.max : box.y.min;
+                    auto z = k ? box.z.max : box.z.min;
+
+                    vec3 tester = transform_point(point3(x, y, z));
+
+                    for (int c = 0; c < 3; c++) {
+                        min[c] = std::fmin(min[c], tester[c]);
+                        max[c] = std::fmax(max[c], tester[c]);
+                    }
+                }
+            }
+        }
+
+        return aabb(min, max);
+    }
+
+    affine inverse() const {
+        // Inverts the linear part with the adjugate, then maps the translation back through it.
+        double det = m[0][0] * (m[1][1]*m[2][2] - m[1][2]*m[2][1])
+                   - m[0][1] * (m[1][0]*m[2][2] - m[1][2]*m[2][0])
+                   + m[0][2] * (m[1][0]*m[2][1] - m[1][1]*m[2][0]);
+        double inv_det = 1.0 / det;
+
+        affine a;
+        a.m[0][0] =  (m[1][1]*m[2][2] - m[1][2]*m[2][1]) * inv_det;
+        a.m[0][1] = -(m[0][1]*m[2][2] - m[0][2]*m[2][1]) * inv_det;
+        a.m[0][2] =  (m[0][1]*m[1][2] - m[0][2]*m[1][1]) * inv_det;
+        a.m[1][0] = -(m[1][0]*m[2][2] - m[1][2]*m[2][0]) * inv_det;
+        a.m[1][1] =  (m[0][0]*m[2][2] - m[0][2]*m[2][0]) * inv_det;
+        a.m[1][2] = -(m[0][0]*m[1][2] - m[0][2]*m[1][0]) * inv_det;
+        a.m[2][0] =  (m[1][0]*m[2][1] - m[1][1]*m[2][0]) * inv_det;
+        a.m[2][1] = -(m[0][0]*m[2][1] - m[0][1]*m[2][0]) * inv_det;
+        a.m[2][2] =  (m[0][0]*m[1][1] - m[0][1]*m[1][0]) * inv_det;
+
+        vec3 t = a.transform_vector(vec3(m[0][3], m[1][3], m[2][3]));
+        a.m[0][3] = -t.x();
+        a.m[1][3] = -t.y();
+        a.m[2][3] = -t.z();
+        return a;
+    }
+};
+
+inline affine operator*(const affine& a, const affine& b) {
+    // Composition: (a * b) applies b first, then a.
+    affine c;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            c.m[i][j] = a.m[i][0]*b.m[0][j] + a.m[i][1]*b.m[1][j] + a.m[i][2]*b.m[2][j];
+        }
+        c.m[i][3] += a.m[i][3];
+    }
+    return c;
+}
+
+#endif
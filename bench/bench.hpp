@@ -0,0 +1,47 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// A small timing harness for the microbenchmarks in this directory. Every benchmark runs its body
+// until at least min_seconds have passed, repeats that a few times, and reports the fastest run in
+// nanoseconds per operation, so that a busy machine shows up as noise in the slow runs only.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+// Keeps the compiler from dropping a computation whose result is otherwise unused.
+template <typename T>
+inline void do_not_optimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct bench_result {
+    double ns_per_op;
+    double mops_per_second;
+};
+
+// Times body(), which performs ops_per_call operations per call, and prints one line.
+template <typename Body>
+bench_result run_bench(const char* name, long ops_per_call, const Body& body,
+                       double min_seconds = 0.05, int runs = 5) {
+    using clock = std::chrono::steady_clock;
+    double best = 1e300;
+
+    for (int run = 0; run < runs; run++) {
+        long calls = 0;
+        auto start = clock::now();
+        double elapsed = 0;
+        do {
+            body();
+            calls++;
+            elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        } while (elapsed < min_seconds);
+        best = std::min(best, elapsed * 1e9 / (double(calls) * ops_per_call));
+    }
+
+    bench_result result { best, 1e3 / best };
+    std::printf("%-22s %9.3f ns/op %10.1f Mops/s\n", name, result.ns_per_op, result.mops_per_second);
+    return result;
+}
+
+#endif
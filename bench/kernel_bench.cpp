@@ -0,0 +1,162 @@
+// Microbenchmarks of the intersection, texture and sampling kernels that a render spends its time
+// in. Inputs are generated from a fixed seed, so every run and every build times the same work;
+// quote its numbers with any change that is meant to make one of these faster.
+//
+// Build and run from the repository root (image_texture looks for textures/earthmap.jpg there):
+//   g++ -O2 -std=c++17 -Iinclude bench/kernel_bench.cpp -o build/kernel_bench
+//   build/kernel_bench
+// The same -D flags as the renderer (RT_FLOAT, RT_SIMD_VEC3, RT_EXACT_MATH, ...) apply.
+
+#include "../utilis.hpp"
+#include "../bvh.hpp"
+#include "../hittable_list.hpp"
+#include "../pdf.hpp"
+#include "../perlin.hpp"
+#include "../quad.hpp"
+#include "../sphere.hpp"
+#include "../texture.hpp"
+#include "bench.hpp"
+#include <vector>
+
+int main() {
+    std::srand(1);
+    const int n = 1024;
+
+    std::printf("%s build\n", sizeof(real) == sizeof(float) ? "float" : "double");
+
+    // Rays from points around (0, 0, 3) towards points around the unit square at the origin;
+    // about half of them hit each of the shapes below.
+    std::vector<ray> rays(n);
+    for (int i = 0; i < n; i++) {
+        point3 origin = point3(0, 0, 3) + 0.5 * vec3::random(-1, 1);
+        point3 target = point3(0.5, 0.5, 0) + 0.5 * vec3::random(-1, 1);
+        rays[i] = ray(origin, target - origin);
+    }
+    const interval ray_t(0.001, infinity);
+    hit_record rec;
+
+    aabb box(point3(0, 0, -0.5), point3(1, 1, 0.5));
+    run_bench("aabb::hit", n, [&] {
+        int hits = 0;
+        for (int i = 0; i < n; i++) hits += box.hit(rays[i], ray_t);
+        do_not_optimize(hits);
+    });
+
+    sphere ball(point3(0.5, 0.5, 0), 0.5, nullptr);
+    run_bench("sphere::hit", n, [&] {
+        int hits = 0;
+        for (int i = 0; i < n; i++) hits += ball.hit(rays[i], ray_t, rec);
+        do_not_optimize(hits);
+    });
+
+    quad square(point3(0, 0, 0), vec3(1, 0, 0), vec3(0, 1, 0), nullptr);
+    run_bench("quad::hit", n, [&] {
+        int hits = 0;
+        for (int i = 0; i < n; i++) hits += square.hit(rays[i], ray_t, rec);
+        do_not_optimize(hits);
+    });
+
+    // 1000 small spheres filling a 10^3 box, and rays crossing it from random points on a
+    // larger sphere around it.
+    hittable_list balls;
+    for (int k = 0; k < 1000; k++)
+        balls.add(make_shared<sphere>(point3::random(-5, 5), 0.4, nullptr));
+    bvh_node tree(balls);
+    std::vector<ray> scene_rays(n);
+    for (int i = 0; i < n; i++) {
+        point3 origin = 20 * random_unit_vector();
+        scene_rays[i] = ray(origin, point3::random(-5, 5) - origin);
+    }
+    run_bench("bvh_node::hit", n, [&] {
+        int hits = 0;
+        for (int i = 0; i < n; i++) hits += tree.hit(scene_rays[i], ray_t, rec);
+        do_not_optimize(hits);
+    });
+
+    perlin noise;
+    std::vector<point3> points(n);
+    for (int i = 0; i < n; i++)
+        points[i] = point3::random(-10, 10);
+    run_bench("perlin::turb", n, [&] {
+        double sum = 0;
+        for (int i = 0; i < n; i++) sum += noise.turb(points[i], 7);
+        do_not_optimize(sum);
+    });
+
+    image_texture earth("textures/earthmap.jpg");
+    std::vector<double> us(n), vs(n);
+    for (int i = 0; i < n; i++) {
+        us[i] = random_double();
+        vs[i] = random_double();
+    }
+    run_bench("image_texture::value", n, [&] {
+        color sum(0, 0, 0);
+        for (int i = 0; i < n; i++) sum += earth.value(us[i], vs[i], points[i]);
+        do_not_optimize(sum);
+    });
+
+    run_bench("random_unit_vector", n, [&] {
+        vec3 sum(0, 0, 0);
+        for (int i = 0; i < n; i++) sum += random_unit_vector();
+        do_not_optimize(sum);
+    });
+
+    // The pdfs as shade() uses them: cosine lobes about fixed normals, and a quad light and a
+    // sphere light seen from fixed points.
+    std::vector<vec3> normals(n), directions(n);
+    for (int i = 0; i < n; i++) {
+        normals[i] = random_unit_vector();
+        directions[i] = random_unit_vector();
+    }
+    run_bench("cosine_pdf::generate", n, [&] {
+        vec3 sum(0, 0, 0);
+        for (int i = 0; i < n; i++) sum += cosine_pdf(normals[i]).generate();
+        do_not_optimize(sum);
+    });
+    run_bench("cosine_pdf::value", n, [&] {
+        double sum = 0;
+        for (int i = 0; i < n; i++) sum += cosine_pdf(normals[i]).value(directions[i]);
+        do_not_optimize(sum);
+    });
+
+    quad light(point3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), nullptr);
+    sphere glow(point3(278, 400, 278), 60, nullptr);
+    std::vector<point3> viewers(n);
+    for (int i = 0; i < n; i++)
+        viewers[i] = point3(random_double(0, 555), random_double(0, 300), random_double(0, 555));
+
+    run_bench("quad pdf generate", n, [&] {
+        vec3 sum(0, 0, 0);
+        for (int i = 0; i < n; i++) sum += hittable_pdf(light, viewers[i]).generate();
+        do_not_optimize(sum);
+    });
+    run_bench("quad pdf value", n, [&] {
+        double sum = 0;
+        for (int i = 0; i < n; i++)
+            sum += hittable_pdf(light, viewers[i]).value(point3(278, 554, 278) - viewers[i]);
+        do_not_optimize(sum);
+    });
+    run_bench("sphere pdf generate", n, [&] {
+        vec3 sum(0, 0, 0);
+        for (int i = 0; i < n; i++) sum += hittable_pdf(glow, viewers[i]).generate();
+        do_not_optimize(sum);
+    });
+    run_bench("sphere pdf value", n, [&] {
+        double sum = 0;
+        for (int i = 0; i < n; i++)
+            sum += hittable_pdf(glow, viewers[i]).value(point3(278, 400, 278) - viewers[i]);
+        do_not_optimize(sum);
+    });
+
+    // mixture_pdf as shade() builds it per hit, allocation included.
+    run_bench("mixture_pdf", n, [&] {
+        double sum = 0;
+        for (int i = 0; i < n; i++) {
+            mixture_pdf p(make_shared<hittable_pdf>(light, viewers[i]),
+                          make_shared<cosine_pdf>(normals[i]));
+            vec3 direction = p.generate();
+            sum += p.value(direction);
+        }
+        do_not_optimize(sum);
+    });
+}
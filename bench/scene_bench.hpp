@@ -0,0 +1,280 @@
+#ifndef SCENE_BENCH_H
+#define SCENE_BENCH_H
+
+// End-to-end benchmark of the built-in scenes, run as `main bench [options]`:
+//
+//   --scenes 7,8,10     scene numbers, as on the command line (default 7,8,10)
+//   --width 200         image width; the height follows each scene's aspect ratio
+//   --spp 16            samples per pixel
+//   --threads 1,2,4     render thread counts (default 1, 2, 4, ... up to the hardware threads)
+//   --seed 1            std::srand seed, set before each scene is built
+//   --integrator recursive   recursive, or wavefront to force camera::wavefront on, or
+//                            wavefront-sorted to force camera::sort_rays on as well
+//   --out out/bench     writes <out>.csv and <out>.json
+//
+// Every scene is rendered at every thread count with camera::overrides() in force. The harness
+// reports the render time, the time to the first finished band of rows, Mrays/s, the peak
+// resident memory, and the strong-scaling speedup and efficiency against the scene's run with the
+// fewest threads.
+//
+// On POSIX systems each run is in a child process of its own, so the peak memory is that run's
+// alone. Elsewhere the runs share this process and the peak memory is not reported. The renderer
+// draws its random numbers from std::rand, which is shared by all threads, so only single-thread
+// renders are exactly repeatable.
+
+#include "../camera.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <sys/resource.h>
+    #include <sys/wait.h>
+    #include <unistd.h>
+    #define SCENE_BENCH_FORK 1
+#endif
+
+struct scene_bench_run {
+    int scene = 0;
+    render_report report;
+    double total_seconds = 0;       // Scene build, render and image output
+    double peak_rss_mb = -1;        // -1 if unknown
+    double speedup = 1;
+    double efficiency = 1;
+};
+
+class scene_bench {
+  public:
+    // run_scene(n) builds and renders scene n and returns false if there is no such scene.
+    explicit scene_bench(std::function<bool(int)> run_scene) : run_scene(std::move(run_scene)) {}
+
+    // Parses the options after "bench"; returns false, after saying why, if they are invalid.
+    bool parse(int argc, char** argv) {
+        for (int k = 0; k < argc; k++) {
+            std::string option = argv[k];
+            if (k + 1 >= argc) {
+                std::cerr << "ERROR: " << option << " needs a value.\n";
+                return false;
+            }
+            std::string value = argv[++k];
+            if (option == "--scenes")
+                scenes = parse_list(value);
+            else if (option == "--width")
+                width = std::atoi(value.c_str());
+            else if (option == "--spp")
+                spp = std::atoi(value.c_str());
+            else if (option == "--threads")
+                threads = parse_list(value);
+            else if (option == "--seed")
+                seed = unsigned(std::strtoul(value.c_str(), nullptr, 10));
+            else if (option == "--out")
+                out = value;
+            else if (option == "--integrator")
+                integrator = value;
+            else {
+                std::cerr << "ERROR: unknown bench option " << option << ".\n";
+                return false;
+            }
+        }
+        if (integrator != "recursive" && integrator != "wavefront"
+            && integrator != "wavefront-sorted") {
+            std::cerr << "ERROR: the integrator is recursive, wavefront or wavefront-sorted.\n";
+            return false;
+        }
+        if (scenes.empty() || width <= 0 || spp <= 0) {
+            std::cerr << "ERROR: bench needs at least one scene, a positive width and spp.\n";
+            return false;
+        }
+        if (threads.empty()) {
+            int most = std::max(1, int(std::thread::hardware_concurrency()));
+            for (int t = 1; t < most; t *= 2)
+                threads.push_back(t);
+            threads.push_back(most);
+        }
+        for (int t : threads) {
+            if (t <= 0) {
+                std::cerr << "ERROR: thread counts must be positive.\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    int run() {
+        std::vector<scene_bench_run> runs;
+        std::printf("%-6s %5s %9s %9s %11s %9s %9s %8s %7s\n", "scene", "thr", "render_s",
+                    "first_s", "Mrays/s", "total_s", "rss_MB", "speedup", "effic");
+        for (int scene : scenes) {
+            size_t first = runs.size();
+            for (int t : threads) {
+                scene_bench_run r;
+                if (!run_once(scene, unsigned(t), r))
+                    break;
+                runs.push_back(r);
+            }
+            score_scaling(runs, first);
+            for (size_t k = first; k < runs.size(); k++)
+                print(runs[k]);
+        }
+        write_csv(runs);
+        write_json(runs);
+        return runs.empty() ? 1 : 0;
+    }
+
+  private:
+    std::function<bool(int)> run_scene;
+    std::vector<int> scenes { 7, 8, 10 };
+    int width = 200;
+    int spp = 16;
+    std::vector<int> threads;
+    unsigned seed = 1;
+    std::string out = "out/bench";
+    std::string integrator = "recursive";   // Recursive keeps each scene's own choice
+
+    static std::vector<int> parse_list(const std::string& text) {
+        std::vector<int> values;
+        std::stringstream in(text);
+        std::string item;
+        while (std::getline(in, item, ','))
+            values.push_back(std::atoi(item.c_str()));
+        return values;
+    }
+
+    bool run_once(int scene, unsigned n_threads, scene_bench_run& r) {
+        r.scene = scene;
+        camera::overrides() = { width, spp, n_threads, integrator == "wavefront",
+                                integrator == "wavefront-sorted" };
+
+    #ifdef SCENE_BENCH_FORK
+        int fds[2];
+        if (pipe(fds) != 0) {
+            std::cerr << "ERROR: bench cannot create a pipe.\n";
+            return false;
+        }
+        std::cout << std::flush;
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            scene_bench_run child = r;
+            bool ok = render(scene, child);
+            if (ok && write(fds[1], &child, sizeof(child)) != ssize_t(sizeof(child)))
+                ok = false;
+            _exit(ok ? 0 : 1);
+        }
+        close(fds[1]);
+        bool ok = pid > 0 && read(fds[0], &r, sizeof(r)) == ssize_t(sizeof(r));
+        close(fds[0]);
+
+        int status = 0;
+        rusage usage {};
+        if (pid > 0 && wait4(pid, &status, 0, &usage) == pid) {
+        #ifdef __APPLE__
+            r.peak_rss_mb = usage.ru_maxrss / (1024.0 * 1024.0);   // Bytes
+        #else
+            r.peak_rss_mb = usage.ru_maxrss / 1024.0;              // Kilobytes
+        #endif
+        }
+        ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    #else
+        bool ok = render(scene, r);
+    #endif
+        camera::overrides() = camera_overrides();
+        if (!ok)
+            std::cerr << "ERROR: scene " << scene << " did not render; skipping it.\n";
+        return ok;
+    }
+
+    bool render(int scene, scene_bench_run& r) {
+        // Builds and renders the scene with the log silenced, and fills r from the report.
+        std::streambuf* log = std::clog.rdbuf(nullptr);
+        std::srand(seed);
+        camera::last_report() = render_report();
+        auto start = std::chrono::steady_clock::now();
+        bool ok = run_scene(scene);
+        r.total_seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::clog.rdbuf(log);
+        std::clog.clear();
+        r.report = camera::last_report();
+        return ok && r.report.rays > 0;
+    }
+
+    static void score_scaling(std::vector<scene_bench_run>& runs, size_t first) {
+        // Speedup against the run with the fewest threads, and efficiency as the speedup per
+        // thread added.
+        if (first >= runs.size())
+            return;
+        const scene_bench_run* base = &runs[first];
+        for (size_t k = first; k < runs.size(); k++)
+            if (runs[k].report.threads < base->report.threads)
+                base = &runs[k];
+        double base_seconds = base->report.seconds;
+        double base_threads = base->report.threads;
+        for (size_t k = first; k < runs.size(); k++) {
+            scene_bench_run& r = runs[k];
+            r.speedup = r.report.seconds > 0 ? base_seconds / r.report.seconds : 0;
+            r.efficiency = r.speedup * base_threads / r.report.threads;
+        }
+    }
+
+    static double mrays(const scene_bench_run& r) {
+        return r.report.seconds > 0 ? r.report.rays / r.report.seconds * 1e-6 : 0;
+    }
+
+    static void print(const scene_bench_run& r) {
+        std::printf("%-6d %5u %9.3f %9.3f %11.3f %9.3f %9.1f %8.2f %7.2f\n", r.scene,
+                    r.report.threads, r.report.seconds, r.report.first_rows_seconds, mrays(r),
+                    r.total_seconds, r.peak_rss_mb, r.speedup, r.efficiency);
+    }
+
+    void write_csv(const std::vector<scene_bench_run>& runs) const {
+        std::ofstream csv(out + ".csv");
+        if (!csv) {
+            std::cerr << "ERROR: cannot write " << out << ".csv.\n";
+            return;
+        }
+        csv << "scene,integrator,width,height,spp,seed,threads,rays,render_seconds,first_rows_seconds,"
+               "mrays_per_second,total_seconds,peak_rss_mb,speedup,efficiency\n";
+        for (const auto& r : runs)
+            csv << r.scene << ',' << integrator << ',' << r.report.width << ',' << r.report.height << ','
+                << r.report.samples_per_pixel << ',' << seed << ',' << r.report.threads << ','
+                << r.report.rays << ',' << r.report.seconds << ',' << r.report.first_rows_seconds
+                << ',' << mrays(r) << ',' << r.total_seconds << ',' << r.peak_rss_mb << ','
+                << r.speedup << ',' << r.efficiency << '\n';
+        std::printf("Results written to %s.csv and %s.json\n", out.c_str(), out.c_str());
+    }
+
+    void write_json(const std::vector<scene_bench_run>& runs) const {
+        std::ofstream json(out + ".json");
+        if (!json) {
+            std::cerr << "ERROR: cannot write " << out << ".json.\n";
+            return;
+        }
+        json << "{\n  \"width\": " << width << ",\n  \"samples_per_pixel\": " << spp
+             << ",\n  \"seed\": " << seed << ",\n  \"integrator\": \"" << integrator
+             << "\",\n  \"hardware_threads\": "
+             << std::thread::hardware_concurrency() << ",\n  \"runs\": [\n";
+        for (size_t k = 0; k < runs.size(); k++) {
+            const scene_bench_run& r = runs[k];
+            json << "    { \"scene\": " << r.scene << ", \"width\": " << r.report.width
+                 << ", \"height\": " << r.report.height << ", \"threads\": " << r.report.threads
+                 << ", \"rays\": " << r.report.rays << ", \"render_seconds\": " << r.report.seconds
+                 << ", \"first_rows_seconds\": " << r.report.first_rows_seconds
+                 << ", \"mrays_per_second\": " << mrays(r)
+                 << ", \"total_seconds\": " << r.total_seconds
+                 << ", \"peak_rss_mb\": " << r.peak_rss_mb << ", \"speedup\": " << r.speedup
+                 << ", \"efficiency\": " << r.efficiency << " }"
+                 << (k + 1 < runs.size() ? ",\n" : "\n");
+        }
+        json << "  ]\n}\n";
+    }
+};
+
+#endif
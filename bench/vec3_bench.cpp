@@ -0,0 +1,82 @@
+// Microbenchmarks of the vec3 kernels that the hit tests and scattering code are built from.
+//
+// Build from the repository root, with and without the SIMD backend, and compare:
+//   g++ -O2 -march=native -std=c++17 -Iinclude bench/vec3_bench.cpp -o build/vec3_bench
+//   g++ -O2 -march=native -std=c++17 -Iinclude -DRT_SIMD_VEC3 bench/vec3_bench.cpp -o build/vec3_bench_simd
+// Add -DRT_FLOAT to measure the single-precision build.
+
+#include "../utilis.hpp"
+#include "../onb.hpp"
+#include "../sphere.hpp"
+#include "../quad.hpp"
+#include "bench.hpp"
+#include <vector>
+
+int main() {
+    // Fixed inputs: the same vectors on every run and every build.
+    std::srand(1);
+    const int n = 1024;
+    std::vector<vec3> a(n), b(n), normals(n), out(n);
+    for (int i = 0; i < n; i++) {
+        a[i] = vec3::random(-1, 1);
+        b[i] = vec3::random(-1, 1);
+        normals[i] = random_unit_vector();
+    }
+
+    std::printf("vec3: %d bytes, %s, %s backend\n", int(sizeof(vec3)),
+                sizeof(real) == sizeof(float) ? "float" : "double",
+                vec3::lanes == 4 ? "SIMD" : "scalar");
+
+    run_bench("add", n, [&] {
+        for (int i = 0; i < n; i++) out[i] = a[i] + b[i];
+        do_not_optimize(out[0]);
+    });
+    run_bench("scale and accumulate", n, [&] {
+        for (int i = 0; i < n; i++) out[i] += 0.5 * a[i];
+        do_not_optimize(out[0]);
+    });
+    run_bench("dot", n, [&] {
+        real sum = 0;
+        for (int i = 0; i < n; i++) sum += dot(a[i], b[i]);
+        do_not_optimize(sum);
+    });
+    run_bench("cross", n, [&] {
+        for (int i = 0; i < n; i++) out[i] = cross(a[i], b[i]);
+        do_not_optimize(out[0]);
+    });
+    run_bench("unit_vector", n, [&] {
+        for (int i = 0; i < n; i++) out[i] = unit_vector(a[i]);
+        do_not_optimize(out[0]);
+    });
+    run_bench("reflect", n, [&] {
+        for (int i = 0; i < n; i++) out[i] = reflect(a[i], normals[i]);
+        do_not_optimize(out[0]);
+    });
+    run_bench("refract", n, [&] {
+        for (int i = 0; i < n; i++) out[i] = refract(normals[i], -normals[(i + 1) % n], 1 / 1.5);
+        do_not_optimize(out[0]);
+    });
+    run_bench("onb transform", n, [&] {
+        for (int i = 0; i < n; i++) out[i] = onb(normals[i]).transform(a[i]);
+        do_not_optimize(out[0]);
+    });
+
+    // Whole hit tests: rays from random points in a box towards a unit quad and a unit sphere.
+    std::vector<ray> rays(n);
+    for (int i = 0; i < n; i++)
+        rays[i] = ray(point3(0, 0, 3) + 0.5 * a[i], point3(0.5, 0.5, 0) + 0.5 * b[i] - (point3(0, 0, 3) + 0.5 * a[i]));
+    quad square(point3(0, 0, 0), vec3(1, 0, 0), vec3(0, 1, 0), nullptr);
+    sphere ball(point3(0, 0, 0), 1, nullptr);
+    hit_record rec;
+
+    run_bench("quad::hit", n, [&] {
+        int hits = 0;
+        for (int i = 0; i < n; i++) hits += square.hit(rays[i], interval(0.001, infinity), rec);
+        do_not_optimize(hits);
+    });
+    run_bench("sphere::hit", n, [&] {
+        int hits = 0;
+        for (int i = 0; i < n; i++) hits += ball.hit(rays[i], interval(0.001, infinity), rec);
+        do_not_optimize(hits);
+    });
+}
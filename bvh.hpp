@@ -3,7 +3,10 @@
 #include "aabb.hpp"
 #include "hittable.hpp"
 #include "hittable_list.hpp"
+#include "counters.hpp"
+#include "trace.hpp"
 #include <algorithm>
+#include <cstdint>
 
 class bvh_node : public hittable {
   public : 
@@ -12,6 +15,8 @@ class bvh_node : public hittable {
     }
 
     bvh_node(std::vector<shared_ptr<hittable>>& objects, size_t start,size_t end) {
+        // Only the root of the tree is traced.
+        trace_span build(start == 0 && end == objects.size() ? "bvh build" : nullptr, "scene");
 
         bbox = aabb::empty;
         for (size_t object_index = start ; object_index < end ; object_index ++){
@@ -40,25 +45,94 @@ class bvh_node : public hittable {
         }
 
         bbox = aabb(left->bounding_box(), right->bounding_box());
+        split_axis = axis;
+        left_node = dynamic_cast<const bvh_node*>(left.get());
+        right_node = dynamic_cast<const bvh_node*>(right.get());
+
+        ray_packet::float_box(bbox, box_min, box_max);
     }
 
     bool hit (const ray&r , interval ray_t, hit_record& rec) const override {
+        return intersect_and_finish(r, ray_t, rec);
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        RT_COUNT(node_visits, 1);
         if (!bbox.hit(r, ray_t))
             return false;
+        RT_COUNT(primitive_tests, (left_node ? 0 : 1) + (right_node || right == left ? 0 : 1));
 
-        bool hit_left = left->hit(r, ray_t, rec);
-        bool hit_right = right->hit(r, interval(ray_t.min, hit_left ? rec.t : ray_t.max), rec);
+        bool hit_left = left->intersect(r, ray_t, rec);
+        bool hit_right = right->intersect(r, interval(ray_t.min, hit_left ? rec.t : ray_t.max), rec);
 
         return hit_left || hit_right;
     }
 
+    uint64_t hit_packet(ray_packet& packet, uint64_t mask, hit_record* recs) const override {
+        // Walks the tree once for the whole packet, testing each box against all live rays with
+        // SIMD. Subtrees that only a few rays still reach are handed back to single-ray hit().
+        struct stack_entry { const bvh_node* node; uint64_t mask; };
+        stack_entry stack[max_packet_depth];
+        int stack_size = 0;
+        stack[stack_size++] = { this, mask };
+        uint64_t hits = 0;
+
+        while (stack_size > 0) {
+            const stack_entry entry = stack[--stack_size];
+            const bvh_node& node = *entry.node;
+            RT_COUNT(node_visits, ray_packet::count(entry.mask));
+
+            uint64_t active = packet.hits_box(node.box_min, node.box_max, entry.mask);
+            if (!active)
+                continue;
+
+            if (ray_packet::count(active) < min_packet_rays || stack_size + 2 > max_packet_depth) {
+                hits |= node.hittable::hit_packet(packet, active, recs);
+                continue;
+            }
+
+            // Visit the child on the near side of the split first, judged by the first live ray.
+            const vec3& d = packet.rays[ray_packet::lowest(active)].direction();
+            bool left_first = d[node.split_axis] >= 0;
+            const hittable* near_child = left_first ? node.left.get() : node.right.get();
+            const hittable* far_child  = left_first ? node.right.get() : node.left.get();
+            const bvh_node* near_node  = left_first ? node.left_node : node.right_node;
+            const bvh_node* far_node   = left_first ? node.right_node : node.left_node;
+
+            // Leaf children are tested straight away; interior children go on the shared stack,
+            // far one first so the near one is popped next.
+            if (far_child != near_child) {
+                if (far_node)
+                    stack[stack_size++] = { far_node, active };
+                else
+                    hits |= far_child->hit_packet(packet, active, recs);
+            }
+            if (near_node)
+                stack[stack_size++] = { near_node, active };
+            else
+                hits |= near_child->hit_packet(packet, active, recs);
+        }
+
+        return hits;
+    }
+
     aabb bounding_box() const override { return bbox; }
     
   private :
     shared_ptr<hittable> left ;
     shared_ptr<hittable> right ;
     aabb bbox ;
-    
+
+    // Packet traversal: children that are bvh_nodes (so they can go on the stack without a
+    // virtual call) and a float copy of bbox.
+    const bvh_node* left_node = nullptr;
+    const bvh_node* right_node = nullptr;
+    int split_axis = 0;
+    float box_min[3], box_max[3];
+
+    static const int min_packet_rays = 4;      // Below this many live rays, trace them singly
+    static const int max_packet_depth = 128;
+
     static bool box_compare(
         const shared_ptr<hittable> a, const shared_ptr<hittable> b, int axis_index
     ) {
@@ -7,10 +7,37 @@
 #include "hittable.hpp"
 #include "pdf.hpp"
 #include "material.hpp"
-#include <indicators/dynamic_progress.hpp>
-#include <indicators/progress_bar.hpp>
-using namespace indicators;
+#include "ray_packet.hpp"
+#include "counters.hpp"
+#include "cost_map.hpp"
+#include "trace.hpp"
+#include "progress.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <type_traits>
+
+
+// Settings that take precedence over the ones a scene gives its camera, so that a harness can run
+// the scenes unchanged at a common resolution, sample count and thread count (see
+// bench/scene_bench.hpp). Zero keeps the scene's own value.
+struct camera_overrides {
+    int image_width = 0;
+    int samples_per_pixel = 0;
+    unsigned threads = 0;           // For render_multi_threads
+    bool wavefront = false;         // Use the wavefront integrator even if the scene does not
+    bool sort_rays = false;         // Also sort its waves; implies wavefront
+};
 
+// Timings and totals of the most recent render, whichever camera did it.
+struct render_report {
+    int width = 0, height = 0, samples_per_pixel = 0;
+    unsigned threads = 0;
+    uint64_t rays = 0;
+    double seconds = 0;             // From the start of the render to the last pixel, output excluded
+    double first_rows_seconds = 0;  // To the first completed band of rows (one tile high)
+};
 
 class camera{
   public :
@@ -30,67 +57,73 @@ class camera{
     double focus_dist = 10;    // Distance from camera lookfrom point to plane of perfect focus
     unsigned int  n_threads;
 
+    // Camera rays are traced in packet_size x packet_size packets (at most 8); 1 traces every
+    // camera ray on its own.
+    int packet_size = 8;
+
+    // Use the wavefront integrator: trace a large batch of paths one bounce at a time, shading
+    // the hits material by material, instead of following each sample's path recursively.
+    bool wavefront = false;
+    // Paths in flight, shared among the render threads. Each thread's batch is also capped at
+    // the samples it has to take, so small renders do not allocate for empty slots.
+    int wavefront_paths = 1 << 16;
+    // Before tracing each secondary wave, reorder it by a Morton key of ray origin and direction
+    // so that consecutive rays walk the same BVH nodes and primitives. This pays off once the
+    // scene is much bigger than the caches; below that the sort costs more than it saves.
+    bool sort_rays = false;
+
+    // Where the pixel positions, lens and time samples and the random decisions along each path
+    // come from (see sampler.hpp), e.g. make_shared<sobol_sampler>(). Null means independent
+    // random numbers and stratified pixel positions.
+    shared_ptr<sampler> pixel_sampler;
+
+    // Also record what each pixel cost to render and write it next to the image as out/cost_*
+    // (see cost_map.hpp). The costs are charged ray by ray, so camera rays are then traced one at
+    // a time and the recursive integrator is used even if wavefront is set.
+    bool cost_maps = false;
+
+    // Append the progress reports to this file every few seconds instead of redrawing them on
+    // the terminal, for batch jobs (see progress.hpp). Empty means the RT_PROGRESS_LOG
+    // environment variable, if set, and otherwise the terminal.
+    std::string progress_log;
+
+    static camera_overrides& overrides() {
+        static camera_overrides o;
+        return o;
+    }
+
+    static render_report& last_report() {
+        static render_report r;
+        return r;
+    }
+
     void render_multi_threads (const hittable& world, const hittable& lights){
 
         initialize();
+        counter_summary::begin();
+        trace_span render_span("render");
 
         const int W = image_width;
         const int H = image_height;
 
         std::vector<color> framebuffer(W * H);
+        costs.reset(cost_maps ? new cost_map(W, H) : nullptr);
         // 決定使用的執行緒數
-        n_threads = std::thread::hardware_concurrency();
+        n_threads = overrides().threads ? overrides().threads : std::thread::hardware_concurrency();
         if (n_threads == 0) n_threads = 4;  
         std::clog << "number of thread in use : " << n_threads << "\n" << std::flush;
         
         // 把 H 列平分給各執行緒
         int rows_per_thread = H / n_threads;
 
-        std::vector<std::unique_ptr<ProgressBar>> bars_vec;
-            for (unsigned t = 0; t < n_threads; ++t) {
-                int rows = rows_per_thread;
-
-                char buf[16] ;
-                std::snprintf(buf, sizeof(buf), "Worker %2u: ", t);
-
-                bars_vec.emplace_back(std::make_unique<ProgressBar>(
-                    option::Stream{std::clog},
-                    option::BarWidth{50},
-                    option::MaxProgress{rows},
-                    option::PrefixText{buf},
-                    indicators::option::FontStyles{
-                        std::vector<indicators::FontStyle>{indicators::FontStyle::bold}}));
-            }
-
-        DynamicProgress<ProgressBar> bars(std::move(bars_vec[0]));
-        for (unsigned t = 1; t < n_threads; ++t)
-            bars.push_back(std::move(bars_vec[t]));
-        bars.set_option(option::HideBarWhenComplete{false});
-
-        auto worker = [&](int start_row, int end_row, int tid) {
-            
-            int total = end_row - start_row;
-
-            for (int j = start_row; j < end_row; ++j) {
-                for (int i = 0; i < W; ++i) {
-                    
-                    color pixel_color(0.0, 0.0, 0.0);
-                    for (int s_j = 0 ; s_j < sqrt_spp ; s_j++){
-                        for (int s_i = 0 ; s_i < sqrt_spp ; s_i++){
-                            ray r = get_ray(i, j, s_i, s_j);
-                            pixel_color += ray_color(r, max_depth, world, lights);
-                        }
-                    }
-                    // 平均
-                    pixel_color *= pixel_sample_scale;
-                    // 存到 framebuffer
-                    framebuffer[j * W + i] = pixel_color;
-                    
-                }
-                bars[tid].tick();
-     
-            }
-
+        start_progress();
+        auto worker = [&](int start_row, int end_row) {
+            trace_span rows_span("rows", "render", 0, start_row);
+            auto rows_done = [&](int) { note_rows_done(); };
+            if (wavefront && !costs)
+                render_rows_wavefront(world, lights, start_row, end_row, framebuffer, rows_done);
+            else
+                render_rows(world, lights, start_row, end_row, framebuffer, rows_done);
         };
         
         std::vector<std::thread> threads;
@@ -99,47 +132,66 @@ class camera{
         
         for (unsigned t = 0; t < n_threads; ++t) {
             int row_end = (t == n_threads - 1) ? H : row_start + rows_per_thread;
-            threads.emplace_back(worker, row_start, row_end, t);
+            threads.emplace_back(worker, row_start, row_end);
             row_start = row_end;
         }
 
         for (auto& th : threads) th.join();
-
-        std::ofstream ofs("out/img.ppm");
-        ofs << "P3\n" << W << ' ' << H << "\n255\n";
-
-        for (int idx = 0; idx < W * H; ++idx) {
-            write_color(ofs, framebuffer[idx]);
-        }
+        progress->finish();
+        finish_report();
+
+        render_span.end();
+        auto output_start = std::chrono::steady_clock::now();
+        write_image(framebuffer);
+        report_totals();
+        counter_summary::write("out/stats.json", W, H, spp, n_threads, elapsed_ns(output_start));
+        if (costs)
+            costs->write("out/cost", spp);
         std::clog << "Done.\n\n";
     }
 
 
     void render(const hittable& world, const hittable& lights){
         initialize();
-        std::ofstream ofs("out/img.ppm");
-        ofs << "P3\n" << image_width << ' ' << image_height << "\n255\n";
-        for (int j = 0; j < image_height; j++) {
-            std::clog << "\rScanlines remaining: " << (image_height - j) << ' ' << std::flush;
-            for (int i = 0; i < image_width; i++) {
-                color pixel_color (0.0, 0.0, 0.0);
-                for (int s_j = 0 ; s_j < sqrt_spp ; s_j++){
-                    for (int s_i = 0 ; s_i < sqrt_spp ; s_i++){
-                        ray r = get_ray(i, j, s_i, s_j);
-                        pixel_color += ray_color(r, max_depth, world, lights);
-                    }
-                }
-                write_color(ofs, pixel_sample_scale * pixel_color);
-            }
-        }
-        ofs.close();
+        counter_summary::begin();
+        trace_span render_span("render");
+
+        const int W = image_width;
+        const int H = image_height;
+        std::vector<color> framebuffer(W * H);
+        costs.reset(cost_maps ? new cost_map(W, H) : nullptr);
+
+        n_threads = 1;
+        start_progress();
+        auto rows_done = [&](int) { note_rows_done(); };
+        if (wavefront && !costs)
+            render_rows_wavefront(world, lights, 0, H, framebuffer, rows_done);
+        else
+            render_rows(world, lights, 0, H, framebuffer, rows_done);
+        progress->finish();
+        finish_report();
+
+        render_span.end();
+        auto output_start = std::chrono::steady_clock::now();
+        write_image(framebuffer);
+        report_totals();
+        counter_summary::write("out/stats.json", W, H, spp, 1, elapsed_ns(output_start));
+        if (costs)
+            costs->write("out/cost", spp);
     }
 
+    // Exact totals of the last render, for cost models: camera samples (pixels times samples per
+    // pixel) and rays intersected with the world, camera rays included.
+    uint64_t samples_traced() const { return uint64_t(int(image_width)) * image_height * spp; }
+    uint64_t rays_traced() const { return rays_traced_total; }
+
   private :
-    int image_height;            // Rendered image height
+    int image_height = 0;        // Rendered image height
     double pixel_sample_scale;   // Color scale factor for a sum of pixel samples
-    int sqrt_spp;               // Square root of number of samples per pixel
-    double recip_sqrt_spp;      // 1 / sqrt_spp
+    int spp = 0;                 // Samples per pixel actually taken, max(1, samples_per_pixel)
+    int strata_x, strata_y;      // Sample strata: the first strata_x * strata_y samples
+    double recip_strata_x;       // 1 / strata_x
+    double recip_strata_y;       // 1 / strata_y
     point3 center;               // Camera center
     point3 pixel00_loc;          // Location of pixel 0, 0
     vec3 pixel_delta_u;
@@ -147,16 +199,45 @@ class camera{
     vec3   u, v, w;              // Camera frame basis vectors
     vec3 defocus_disk_u;         // Defocus disk horizontal radius
     vec3 defocus_disk_v;         // Defocus disk vertical radius
+    mutable std::atomic<uint64_t> rays_traced_total{0};    // Summed by the render threads
+    std::unique_ptr<cost_map> costs;    // Per-pixel costs of the render, if cost_maps
+    std::unique_ptr<render_progress> progress;  // Samples and rays done, for the reporter thread
+    std::chrono::steady_clock::time_point render_start;
+    mutable std::atomic<uint64_t> first_rows_ns{0};     // 0 until a band of rows is done
 
     //初始化相機參數
     void initialize(){
+        if (overrides().image_width > 0)
+            image_width = overrides().image_width;
+        if (overrides().samples_per_pixel > 0)
+            samples_per_pixel = overrides().samples_per_pixel;
+        if (overrides().wavefront || overrides().sort_rays)
+            wavefront = true;
+        if (overrides().sort_rays)
+            sort_rays = true;
+        render_start = std::chrono::steady_clock::now();
+        first_rows_ns = 0;
+
         // Calculate the image height, and ensure that it's at least 1.
         image_height = int(image_width / aspect_ratio);
         image_height = (image_height < 1) ? 1 : image_height;
 
-        sqrt_spp = int(std::sqrt(samples_per_pixel));
-        pixel_sample_scale = 1.0 / (sqrt_spp * sqrt_spp);
-        recip_sqrt_spp = 1.0 / sqrt_spp;
+        // The pixel is split into strata_x by strata_y strata, as close to square as the sample
+        // count allows, and each stratum gets one sample. The fewer than strata_y samples left
+        // over go anywhere in the pixel.
+        spp = std::max(1, samples_per_pixel);
+        strata_y = int(std::sqrt(spp));
+        strata_x = spp / strata_y;
+        pixel_sample_scale = 1.0 / spp;
+        recip_strata_x = 1.0 / strata_x;
+        recip_strata_y = 1.0 / strata_y;
+        rays_traced_total = 0;
+
+        std::clog << "Samples per pixel: " << spp << " (" << strata_x << " x " << strata_y
+                  << " strata";
+        if (spp > strata_x * strata_y)
+            std::clog << " + " << spp - strata_x * strata_y << " unstratified";
+        std::clog << ")\n" << std::flush;
 
         center = lookfrom;
 
@@ -193,12 +274,389 @@ class camera{
         defocus_disk_v = v * defocus_radius;//  透鏡上方側
     }
     
-    ray get_ray(int i, int j, int s_i, int s_j) const{
+    template <typename RowsDone>
+    void render_rows(const hittable& world, const hittable& lights, int start_row, int end_row,
+                     std::vector<color>& framebuffer, const RowsDone& rows_done) const {
+        // Renders rows [start_row, end_row) into framebuffer, one band of tiles at a time, and
+        // calls rows_done(n) after every band of n rows.
+        const int W = image_width;
+        const int tile = costs ? 1 : std::max(1, std::min(packet_size, 8));
+        counter_report report("rows " + std::to_string(start_row) + "-" + std::to_string(end_row - 1));
+        RT_TIME(render_ns);
+        const uint64_t rays_before = thread_rays();
+
+        ray_packet packet;
+        hit_record recs[ray_packet::max_size];
+
+        for (int j0 = start_row; j0 < end_row; j0 += tile) {
+            int j1 = std::min(j0 + tile, end_row);
+
+            for (int i0 = 0; i0 < W; i0 += tile) {
+                int i1 = std::min(i0 + tile, W);
+                trace_span tile_span("tile", "render", i0, j0);
+                const uint64_t tile_rays = thread_rays();
+
+                for (int s = 0; s < spp; s++) {
+                    if (tile == 1 || max_depth <= 0) {
+                        RT_COUNT(camera_rays, max_depth > 0 ? (j1 - j0) * (i1 - i0) : 0);
+                        for (int j = j0; j < j1; j++)
+                            for (int i = i0; i < i1; i++) {
+                                cost_map::probe probe;
+                                if (costs)
+                                    probe = cost_map::begin();
+                                framebuffer[j * W + i] +=
+                                    ray_color(get_ray(i, j, s), max_depth, world, lights);
+                                if (costs)
+                                    costs->end(i, j, probe);
+                            }
+                        continue;
+                    }
+
+                    // Trace the tile's camera rays for this sub-pixel sample as one packet,
+                    // then shade each hit on its own.
+                    packet.clear();
+                    for (int j = j0; j < j1; j++)
+                        for (int i = i0; i < i1; i++)
+                            packet.add(get_ray(i, j, s));
+
+                    RT_COUNT(rays, packet.size);
+                    RT_COUNT(camera_rays, packet.size);
+                    thread_rays() += packet.size;
+                    uint64_t hits;
+                    {
+                        RT_TIME(intersect_ns);
+                        hits = world.hit_packet(packet, packet.all(), recs);
+                    }
+
+                    int k = 0;
+                    for (int j = j0; j < j1; j++) {
+                        for (int i = i0; i < i1; i++, k++) {
+                            if (!((hits >> k) & 1)) {
+                                framebuffer[j * W + i] += background;
+                                RT_COUNT_BOUNCES(0);
+                                continue;
+                            }
+                            begin_sample(i, j, s);
+                            framebuffer[j * W + i] +=
+                                shade(packet.rays[k], recs[k], max_depth, world, lights);
+                        }
+                    }
+                }
+                progress->add(uint64_t(j1 - j0) * (i1 - i0) * spp, thread_rays() - tile_rays);
+            }
+
+            // 平均
+            for (int j = j0; j < j1; j++)
+                for (int i = 0; i < W; i++)
+                    framebuffer[j * W + i] *= pixel_sample_scale;
+
+            rows_done(j1 - j0);
+        }
+        rays_traced_total += thread_rays() - rays_before;
+    }
+
+    // One path of the wavefront integrator between bounces.
+    struct path_state {
+        ray r;
+        color throughput;       // Product of attenuation * pdf ratios so far
+        int pixel;              // Index into the framebuffer
+        int depth;              // Bounces left, as the depth argument of ray_color
+        int sample;             // Sample index within the pixel, for pixel_sampler
+    };
+
+    template <typename RowsDone>
+    void render_rows_wavefront(const hittable& world, const hittable& lights, int start_row,
+                               int end_row, std::vector<color>& framebuffer,
+                               const RowsDone& rows_done) const {
+        // Same estimator as ray_color, reorganised: a batch of camera paths is intersected in one
+        // pass, the hits are binned by material kind, every bin is shaded in its own loop, and
+        // the paths that scatter are compacted into the next, smaller wave.
+        const int W = image_width;
+        const long samples_per_row = long(W) * spp;
+        const long total = samples_per_row * (end_row - start_row);
+        const long batch = std::min(total, wavefront_batch_size());
+        const aabb scene_box = world.bounding_box();
+        counter_report report("wavefront rows " + std::to_string(start_row) + "-"
+                              + std::to_string(end_row - 1));
+        RT_TIME(render_ns);
+        const uint64_t rays_before = thread_rays();
+
+        wave_buffers wave;
+        wave.paths.reserve(batch);
+        wave.survivors.reserve(batch);
+        wave.recs.resize(batch);
+        wave.hit.resize(batch);
+        ray_packet packet;
+
+        int rows_finished = 0;
+        for (long first = 0; first < total; first += batch) {
+            long last = std::min(first + batch, total);
+            trace_span batch_span("wavefront batch", "render", 0,
+                                  start_row + int(first / samples_per_row));
+            const uint64_t batch_rays = thread_rays();
+
+            // Camera rays, pixel by pixel and, within a pixel, stratum by stratum.
+            wave.paths.clear();
+            for (long k = first; k < last && max_depth > 0; k++) {
+                int j = start_row + int(k / samples_per_row);
+                long in_row = k % samples_per_row;
+                int i = int(in_row / spp);
+                int s = int(in_row % spp);
+                wave.paths.push_back({ get_ray(i, j, s), color(1, 1, 1), j * W + i, max_depth, s });
+            }
+
+            bool camera_wave = true;
+            while (!wave.paths.empty()) {
+                // Intersect the whole wave; camera rays are coherent enough to go as packets.
+                size_t n = wave.paths.size();
+                RT_COUNT(rays, n);
+                thread_rays() += n;
+                {
+                    RT_TIME(intersect_ns);
+                    if (camera_wave) {
+                        RT_COUNT(camera_rays, n);
+                        for (size_t base = 0; base < n; base += ray_packet::max_size) {
+                            packet.clear();
+                            size_t count = std::min<size_t>(ray_packet::max_size, n - base);
+                            for (size_t k = 0; k < count; k++)
+                                packet.add(wave.paths[base + k].r);
+                            uint64_t hits =
+                                world.hit_packet(packet, packet.all(), &wave.recs[base]);
+                            for (size_t k = 0; k < count; k++)
+                                wave.hit[base + k] = (hits >> k) & 1;
+                        }
+                        camera_wave = false;
+                    } else {
+                        if (sort_rays)
+                            sort_wave(wave, scene_box);
+                        for (size_t k = 0; k < n; k++) {
+                            const ray& r = wave.paths[k].r;
+                            wave.hit[k] = world.hit(r, r.hit_range(), wave.recs[k]);
+                        }
+                    }
+                }
+
+                // Misses pick up the background; hits are binned by material kind.
+                for (auto& bin : wave.bins)
+                    bin.clear();
+                for (size_t k = 0; k < n; k++) {
+                    if (wave.hit[k]) {
+                        wave.bins[int(wave.recs[k].mat->kind)].push_back(uint32_t(k));
+                    } else {
+                        framebuffer[wave.paths[k].pixel] += wave.paths[k].throughput * background;
+                        RT_COUNT_BOUNCES(max_depth - wave.paths[k].depth);
+                    }
+                }
+
+                // Shade bin by bin, collecting the paths that scatter into the next wave.
+                wave.survivors.clear();
+                shade_bin<lambertian>(material_kind::lambertian, wave, lights, framebuffer);
+                shade_bin<metal>(material_kind::metal, wave, lights, framebuffer);
+                shade_bin<dielectric>(material_kind::dielectric, wave, lights, framebuffer);
+                shade_bin<diffuse_light>(material_kind::diffuse_light, wave, lights, framebuffer);
+                shade_bin<isotropic>(material_kind::isotropic, wave, lights, framebuffer);
+                shade_bin<material>(material_kind::custom, wave, lights, framebuffer);
+                wave.paths.swap(wave.survivors);
+            }
+
+            // Rows whose samples are now all in: scale them and report.
+            int rows_complete = int(last / samples_per_row);
+            for (int j = start_row + rows_finished; j < start_row + rows_complete; j++)
+                for (int i = 0; i < W; i++)
+                    framebuffer[j * W + i] *= pixel_sample_scale;
+            if (rows_complete > rows_finished)
+                rows_done(rows_complete - rows_finished);
+            rows_finished = rows_complete;
+            progress->add(uint64_t(last - first), thread_rays() - batch_rays);
+        }
+        rays_traced_total += thread_rays() - rays_before;
+    }
+
+    long wavefront_batch_size() const {
+        // This thread's share of wavefront_paths, but at least min_batch paths so that every
+        // wave stays long enough to bin and sort.
+        const long min_batch = 1 << 12;
+        return std::max(min_batch, long(wavefront_paths) / long(std::max(1u, n_threads)));
+    }
+
+    static uint64_t& thread_rays() {
+        // Rays traced by the calling thread, in any render.
+        thread_local uint64_t rays = 0;
+        return rays;
+    }
+
+    void write_image(const std::vector<color>& framebuffer) const {
+        // Converts the framebuffer to PPM text, then writes it to out/img.ppm in one go.
+        std::ostringstream ppm;
+        {
+            trace_span convert("framebuffer conversion", "output");
+            ppm << "P3\n" << int(image_width) << ' ' << image_height << "\n255\n";
+            for (const color& pixel : framebuffer)
+                write_color(ppm, pixel);
+        }
+        trace_span write("file write", "output");
+        std::ofstream ofs("out/img.ppm");
+        ofs << ppm.str();
+    }
+
+    static uint64_t elapsed_ns(std::chrono::steady_clock::time_point start) {
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+
+    void start_progress() {
+        // Starts the reporter thread for a render of the current size.
+        std::string log_path = progress_log;
+        if (log_path.empty())
+            if (const char* env = std::getenv("RT_PROGRESS_LOG"))
+                log_path = env;
+        progress.reset(new render_progress(samples_traced(), log_path));
+    }
+
+    void note_rows_done() const {
+        if (first_rows_ns.load(std::memory_order_relaxed) == 0) {
+            uint64_t none = 0;
+            first_rows_ns.compare_exchange_strong(none, std::max<uint64_t>(1, elapsed_ns(render_start)));
+        }
+    }
+
+    void finish_report() const {
+        render_report& r = last_report();
+        r.width = int(image_width);
+        r.height = image_height;
+        r.samples_per_pixel = spp;
+        r.threads = n_threads;
+        r.rays = rays_traced();
+        r.seconds = elapsed_ns(render_start) * 1e-9;
+        r.first_rows_seconds = first_rows_ns * 1e-9;
+    }
+
+    void report_totals() const {
+        uint64_t samples = samples_traced(), rays = rays_traced();
+        std::clog << "Traced " << samples << " samples, " << rays << " rays ("
+                  << (samples ? double(rays) / samples : 0.0) << " rays per sample)\n"
+                  << std::flush;
+    }
+
+    // Per-thread storage of the wavefront integrator, reused from wave to wave.
+    struct wave_buffers {
+        std::vector<path_state> paths;      // The current wave
+        std::vector<path_state> survivors;  // The next wave, built while shading
+        std::vector<hit_record> recs;       // recs[k] and hit[k] belong to paths[k]
+        std::vector<char> hit;
+        std::vector<uint32_t> bins[6];      // Indices into paths, one bin per material_kind
+        std::vector<std::pair<uint64_t, uint32_t>> keys;    // Sort key and index into paths,
+        std::vector<std::pair<uint64_t, uint32_t>> sorted_keys; // for sort_wave
+    };
+
+    static void sort_wave(wave_buffers& wave, const aabb& scene_box) {
+        // Reorders wave.paths by ray_key with a least-significant-digit radix sort of the 33-bit
+        // keys, 11 bits a pass, using wave.survivors as scratch space.
+        size_t n = wave.paths.size();
+        wave.keys.resize(n);
+        wave.sorted_keys.resize(n);
+        for (size_t k = 0; k < n; k++)
+            wave.keys[k] = { ray_key(wave.paths[k].r, scene_box), uint32_t(k) };
+
+        for (int shift = 0; shift < 33; shift += 11) {
+            uint32_t offsets[2049] = {};
+            for (const auto& key : wave.keys)
+                offsets[((key.first >> shift) & 2047) + 1]++;
+            for (int digit = 1; digit <= 2048; digit++)
+                offsets[digit] += offsets[digit - 1];
+            for (const auto& key : wave.keys)
+                wave.sorted_keys[offsets[(key.first >> shift) & 2047]++] = key;
+            wave.keys.swap(wave.sorted_keys);
+        }
+
+        wave.survivors.clear();
+        for (const auto& key : wave.keys)
+            wave.survivors.push_back(wave.paths[key.second]);
+        wave.paths.swap(wave.survivors);
+    }
+
+    static uint64_t ray_key(const ray& r, const aabb& scene_box) {
+        // The direction's octant above a 30-bit Morton code of the origin, quantized to a 1024^3
+        // grid over the scene's box: rays heading the same general way are grouped, and within
+        // a group the ones that start close together end up next to each other.
+        uint64_t key = 0;
+        for (int a = 0; a < 3; a++) {
+            const interval& extent = scene_box.axis_interval(a);
+            double size = extent.size() > 0 ? extent.size() : 1.0;
+            double cell = (r.origin()[a] - extent.min) / size * 1024.0;
+            key |= spread_bits(uint32_t(std::clamp(cell, 0.0, 1023.0))) << (2 - a);
+        }
+
+        const vec3& d = r.direction();
+        uint64_t oct = (d.x() < 0) | ((d.y() < 0) << 1) | ((d.z() < 0) << 2);
+        return (oct << 30) | key;
+    }
+
+    static uint64_t spread_bits(uint32_t x) {
+        // Moves bit i of a 10-bit value to bit 3i.
+        uint64_t v = x & 0x3ff;
+        v = (v | (v << 16)) & 0x030000ff;
+        v = (v | (v << 8))  & 0x0300f00f;
+        v = (v | (v << 4))  & 0x030c30c3;
+        v = (v | (v << 2))  & 0x09249249;
+        return v;
+    }
+
+    template <typename M>
+    void shade_bin(material_kind kind, wave_buffers& wave, const hittable& lights,
+                   std::vector<color>& framebuffer) const {
+        // shade() for the hits of one material kind. M is that kind's final class (or the
+        // material base for custom materials), so the calls below bind statically and the loop
+        // body stays small.
+        auto& survivors = wave.survivors;
+        for (uint32_t k : wave.bins[int(kind)]) {
+            const path_state& path = wave.paths[k];
+            const hit_record& rec = wave.recs[k];
+            const M& mat = static_cast<const M&>(*rec.mat);
+            if (pixel_sampler) {
+                begin_sample(path.pixel % int(image_width), path.pixel / int(image_width), path.sample);
+                thread_sample_stream().begin_bounce(max_depth - path.depth);
+            }
+
+            // Only lights and custom materials emit; the other kinds skip the call entirely.
+            if constexpr (std::is_same_v<M, diffuse_light> || std::is_same_v<M, material>)
+                framebuffer[path.pixel] += path.throughput * emitted(mat, path.r, rec);
+
+            scatter_record srec;
+            if (path.depth <= 1 || !mat.scatter(path.r, rec, srec)) {
+                RT_COUNT_BOUNCES(max_depth - path.depth);
+                continue;
+            }
+
+            if (srec.skip_pdf) {
+                survivors.push_back({ srec.skip_pdf_ray, path.throughput * srec.attenuation,
+                                      path.pixel, path.depth - 1, path.sample });
+                continue;
+            }
+
+            // The mixture of light and material pdfs that ray_color builds, without allocating it.
+            hittable_pdf light_pdf(lights, rec.p);
+            vec3 direction = sample_1d() < 0.5 ? light_pdf.generate() : srec.pdf_ptr->generate();
+            double pdf_value = 0.5 * light_pdf.value(direction) + 0.5 * srec.pdf_ptr->value(direction);
+
+            ray scattered(rec.p, direction, path.r.time());
+            double scattering_pdf = mat.scattering_pdf(path.r, rec, scattered);
+            survivors.push_back({ scattered,
+                                  path.throughput * srec.attenuation * scattering_pdf / pdf_value,
+                                  path.pixel, path.depth - 1, path.sample });
+        }
+    }
+
+    ray get_ray(int i, int j, int s) const{
  
         // Construct a camera ray originating from the defocus disk and directed at a randomly
-        // sampled point around the pixel location i, j for stratified sample square s_i, s_j.
-        // vec3 offset = sample_square();
-        vec3 offset = sample_square_stratified(s_i, s_j);
+        // sampled point around the pixel location i, j: in stratum s for the first
+        // strata_x * strata_y samples, anywhere in the pixel for the rest. A pixel_sampler
+        // stratifies the samples of the pixel by itself, so it gets the whole pixel to place them in.
+        begin_sample(i, j, s);
+        vec3 offset = pixel_sampler || s >= strata_x * strata_y
+                    ? sample_square()
+                    : sample_square_stratified(s % strata_x, s / strata_x);
         point3 pixel_sample =   pixel00_loc 
                                 + ((i + offset.x()) * pixel_delta_u) 
                                 + ((j + offset.y()) * pixel_delta_v);
@@ -206,25 +664,32 @@ class camera{
         point3 ray_origin = defocus_angle < 0 ? center : defocus_disk_sample();
         vec3 ray_direction = pixel_sample - ray_origin;
         
-        double ray_time = random_double();
+        double ray_time = sample_1d();
         
         return ray(ray_origin, ray_direction, ray_time);
 
     }
 
     vec3 sample_square_stratified(int s_i, int s_j) const {
-        // Returns the vector to a random point in the square sub-pixel specified by grid
-        // indices s_i and s_j, for an idealized unit square pixel [-.5,-.5] to [+.5,+.5].
+        // Returns the vector to a random point in the sub-pixel specified by grid indices s_i
+        // and s_j, for an idealized unit square pixel [-.5,-.5] to [+.5,+.5].
 
-        auto px = ((s_i + random_double()) * recip_sqrt_spp) - 0.5;
-        auto py = ((s_j + random_double()) * recip_sqrt_spp) - 0.5;
+        auto px = ((s_i + random_double()) * recip_strata_x) - 0.5;
+        auto py = ((s_j + random_double()) * recip_strata_y) - 0.5;
 
         return vec3(px, py, 0);
     }
 
     vec3 sample_square() const {
         // Returns the vector to a random point in the [-.5,-.5]-[+.5,+.5] unit square.
-        return vec3(random_double() - 0.5, random_double() - 0.5, 0);
+        double x = sample_1d();
+        return vec3(x - 0.5, sample_1d() - 0.5, 0);
+    }
+
+    void begin_sample(int i, int j, int sample) const {
+        // Points this thread's sample stream at the camera dimensions of sample `sample` of pixel
+        // (i, j). Without a pixel_sampler this only turns the stream off.
+        thread_sample_stream().begin_sample(pixel_sampler.get(), i, j, uint32_t(sample));
     }
     
 
@@ -236,22 +701,45 @@ class camera{
 
 
     color ray_color(const ray& r, int depth,const hittable& world, const hittable& lights) const{
-        if (depth <= 0) return color(0, 0, 0);
+        if (depth <= 0) {
+            RT_COUNT_BOUNCES(max_depth - 1);
+            return color(0, 0, 0);
+        }
 
+        RT_COUNT(rays, 1);
+        thread_rays()++;
         hit_record rec;
+        bool hit;
+        {
+            RT_TIME(intersect_ns);
+            hit = world.hit(r, r.hit_range(), rec);  //用bvh優化，原本對整體物件進行線性搜索O(n) -> O(log n)
+        }
         //if hit 
-        if (!world.hit(r, interval(0.001, infinity), rec))  //用bvh優化，原本對整體物件進行線性搜索O(n) -> O(log n)
+        if (!hit) {
+            RT_COUNT_BOUNCES(max_depth - depth);
             return background;
-        
+        }
+
+        return shade(r, rec, depth, world, lights);
+    }
+
+    color shade(const ray& r, const hit_record& rec, int depth, const hittable& world,
+                const hittable& lights) const {
+        // The colour carried back along r from its hit rec: emission plus scattered light.
         // ray scattered;
         // color attenuation;
         // double pdf_value;
+        if (pixel_sampler)
+            thread_sample_stream().begin_bounce(max_depth - depth);
+
         scatter_record srec;
-        color color_from_emission = rec.mat->emitted(r, rec, rec.u, rec.v, rec.p);
+        color color_from_emission = emitted(*rec.mat, r, rec);
         
         ///
-        if (!rec.mat->scatter(r, rec, srec))
+        if (!scatter(*rec.mat, r, rec, srec)) {
+            RT_COUNT_BOUNCES(max_depth - depth);
             return color_from_emission;
+        }
         
         if (srec.skip_pdf) {
             return srec.attenuation * ray_color(srec.skip_pdf_ray, depth-1, world, lights);
@@ -266,7 +754,7 @@ class camera{
         ray scattered = ray(rec.p, p.generate(), r.time());
         auto pdf_value = p.value(scattered.direction());
 
-        double scattering_pdf = rec.mat->scattering_pdf(r, rec, scattered);
+        double scattering_pdf = ::scattering_pdf(*rec.mat, r, rec, scattered);
 
         color sample_color = ray_color(scattered, depth-1, world, lights);
         color color_from_scatter =
@@ -5,48 +5,37 @@
 #include "material.hpp"
 #include "texture.hpp"
 
+// A medium of uniform density filling a closed boundary. The distance to the next scattering
+// event is sampled once per ray and spent along the parts of the ray that are inside the boundary.
+//
+// A convex boundary (see hittable::is_convex) gives entry and exit in one convex_span() query.
+// Any other boundary is walked one crossing at a time with intersect(), which skips the shading
+// data hit() would compute, and the crossings are paired up as entry and exit. That also handles
+// boundaries the ray enters more than once, such as concave meshes or shells nested in a list.
 class constant_medium : public hittable {
   public:
     constant_medium(shared_ptr<hittable> boundary, double density, shared_ptr<texture> tex)
       : boundary(boundary), neg_inv_density(-1/density),
-        phase_function(make_shared<isotropic>(tex))
+        phase_function(make_shared<isotropic>(tex)), convex(boundary->is_convex())
     {}
 
     constant_medium(shared_ptr<hittable> boundary, double density, const color& albedo)
       : boundary(boundary), neg_inv_density(-1/density),
-        phase_function(make_shared<isotropic>(albedo))
+        phase_function(make_shared<isotropic>(albedo)), convex(boundary->is_convex())
     {}
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        hit_record rec1, rec2;
-
-        if (!boundary->hit(r, interval::universe, rec1))
-            return false;
-
-        if (!boundary->hit(r, interval(rec1.t+0.0001, infinity), rec2))
-            return false;
-
-        if (rec1.t < ray_t.min) rec1.t = ray_t.min;
-        if (rec2.t > ray_t.max) rec2.t = ray_t.max;
-
-        if (rec1.t >= rec2.t)
+        RT_COUNT_TEST(medium);
+        auto t = convex ? hit_convex(r, ray_t) : hit_general(r, ray_t);
+        if (!(t < infinity))
             return false;
 
-        if (rec1.t < 0)
-            rec1.t = 0;
-
-        auto ray_length = r.direction().length();
-        auto distance_inside_boundary = (rec2.t - rec1.t) * ray_length;
-        auto hit_distance = neg_inv_density * std::log(random_double());
-
-        if (hit_distance > distance_inside_boundary)
-            return false;
-
-        rec.t = rec1.t + hit_distance / ray_length;
+        rec.t = t;
         rec.p = r.at(rec.t);
 
         rec.normal = vec3(1,0,0);  // arbitrary
         rec.front_face = true;     // also arbitrary
+        rec.deferred_uv = nullptr;
         rec.mat = phase_function;
 
         return true;
@@ -58,6 +47,72 @@ class constant_medium : public hittable {
     shared_ptr<hittable> boundary;
     double neg_inv_density;
     shared_ptr<material> phase_function;
+    bool convex;
+
+    real hit_convex(const ray& r, interval ray_t) const {
+        // Returns the t of the scattering event, or infinity if the ray passes through.
+        interval inside;
+        if (!boundary->convex_span(r, inside))
+            return infinity;
+
+        if (!overlaps(inside, ray_t))
+            return infinity;
+
+        auto ray_length = r.direction().length();
+        double hit_distance = neg_inv_density * std::log(sample_1d());
+        return scatter_in(inside, ray_t, ray_length, hit_distance);
+    }
+
+    real hit_general(const ray& r, interval ray_t) const {
+        auto ray_length = r.direction().length();
+        double hit_distance = -1;       // Sampled at the first span that overlaps ray_t
+
+        hit_record entry, exit;
+        real t = -infinity;
+        while (t < ray_t.max) {
+            // An entry past ray_t.max cannot matter, so the first query stops there; the exit
+            // query cannot, since a miss there means the ray only grazed the boundary.
+            if (!boundary->intersect(r, interval(t, ray_t.max), entry))
+                return infinity;
+            if (!boundary->intersect(r, interval(entry.t+0.0001, infinity), exit))
+                return infinity;
+
+            if (hit_distance < 0 && overlaps(interval(entry.t, exit.t), ray_t))
+                hit_distance = neg_inv_density * std::log(sample_1d());
+
+            auto t_hit = scatter_in(interval(entry.t, exit.t), ray_t, ray_length, hit_distance);
+            if (t_hit < infinity)
+                return t_hit;
+            t = exit.t + 0.0001;
+        }
+        return infinity;
+    }
+
+    static bool overlaps(interval inside, interval ray_t) {
+        return std::fmax(inside.min, ray_t.min) < std::fmin(inside.max, ray_t.max);
+    }
+
+    static real scatter_in(interval inside, interval ray_t, real ray_length, double& hit_distance) {
+        // The t at which hit_distance runs out inside `inside` (clipped to ray_t), or infinity
+        // with hit_distance reduced by the length crossed.
+        if (inside.min < ray_t.min) inside.min = ray_t.min;
+        if (inside.max > ray_t.max) inside.max = ray_t.max;
+
+        if (inside.min >= inside.max)
+            return infinity;
+
+        if (inside.min < 0)
+            inside.min = 0;
+        if (inside.min >= inside.max)
+            return infinity;
+
+        auto distance_inside_boundary = (inside.max - inside.min) * ray_length;
+        if (hit_distance > distance_inside_boundary) {
+            hit_distance -= distance_inside_boundary;
+            return infinity;
+        }
+        return inside.min + hit_distance / ray_length;
+    }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,155 @@
+#ifndef COST_MAP_H
+#define COST_MAP_H
+
+// Per-pixel render cost, for finding what makes a scene slow: the BVH nodes visited, the exact
+// primitive tests and the wall-clock time spent on each pixel's samples, whole paths included.
+// Node visits and primitive tests come from the traversal counters, so they are recorded only in
+// builds with -DRT_COUNTERS; the time is recorded in every build.
+//
+// write() saves each measure as a false-colour image, and all three as a raw float buffer:
+//     <prefix>_nodes.ppm, <prefix>_tests.ppm, <prefix>_time.ppm
+//     <prefix>.pfm        nodes, tests and nanoseconds per sample as the R, G and B channels
+// The false colours run from black through red and orange to white, linearly up to the 99th
+// percentile of the image, so that a few extreme pixels do not flatten the rest.
+
+#include "counters.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+class cost_map {
+  public:
+    cost_map(int width, int height)
+      : width(width), height(height), nodes(size_t(width) * height),
+        tests(size_t(width) * height), nanoseconds(size_t(width) * height) {}
+
+    // What the calling thread had counted when a sample started.
+    struct probe {
+        uint64_t nodes = 0;
+        uint64_t tests = 0;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    static probe begin() {
+        probe p;
+    #ifdef RT_COUNTERS
+        const traversal_counters& c = thread_counters();
+        p.nodes = c.node_visits;
+        p.tests = tests_of(c);
+    #endif
+        p.start = std::chrono::steady_clock::now();
+        return p;
+    }
+
+    // Charges the work since `p` to pixel (i, j). Each pixel belongs to one render thread, so
+    // no locking is needed.
+    void end(int i, int j, const probe& p) {
+        size_t k = size_t(j) * width + i;
+        nanoseconds[k] += double(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - p.start).count());
+    #ifdef RT_COUNTERS
+        const traversal_counters& c = thread_counters();
+        nodes[k] += double(c.node_visits - p.nodes);
+        tests[k] += double(tests_of(c) - p.tests);
+    #endif
+    }
+
+    void write(const std::string& prefix, int samples_per_pixel) const {
+        // Everything is written per sample.
+        double per_sample = 1.0 / std::max(1, samples_per_pixel);
+        bool counted = false;
+    #ifdef RT_COUNTERS
+        counted = true;
+    #endif
+
+        double nodes_max = write_false_colour(prefix + "_nodes.ppm", nodes, per_sample);
+        double tests_max = write_false_colour(prefix + "_tests.ppm", tests, per_sample);
+        double time_max = write_false_colour(prefix + "_time.ppm", nanoseconds, per_sample);
+        write_pfm(prefix + ".pfm", per_sample);
+
+        std::clog << "Cost maps written to " << prefix << "_{nodes,tests,time}.ppm and " << prefix
+                  << ".pfm; white is " << time_max * 1e-3 << " us";
+        if (counted)
+            std::clog << ", " << nodes_max << " nodes and " << tests_max << " tests";
+        else
+            std::clog << " (node and test counts need -DRT_COUNTERS)";
+        std::clog << " per sample\n" << std::flush;
+    }
+
+  private:
+    int width, height;
+    std::vector<double> nodes;          // Per pixel, summed over its samples
+    std::vector<double> tests;
+    std::vector<double> nanoseconds;
+
+    static uint64_t tests_of(const traversal_counters& c) {
+        uint64_t sum = 0;
+        for (uint64_t n : c.type_tests)
+            sum += n;
+        return sum;
+    }
+
+    double write_false_colour(const std::string& path, const std::vector<double>& values,
+                              double scale) const {
+        // Writes values * scale as false colour and returns the value shown as white.
+        std::vector<double> sorted(values);
+        size_t k = std::min(sorted.size() - 1, sorted.size() * 99 / 100);
+        std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+        double white = sorted[k] * scale;
+        double recip = white > 0 ? 1 / white : 0;
+
+        std::ofstream out(path);
+        if (!out) {
+            std::cerr << "ERROR: cannot write " << path << ".\n";
+            return white;
+        }
+        out << "P3\n" << width << ' ' << height << "\n255\n";
+        for (double v : values) {
+            int r, g, b;
+            false_colour(std::min(1.0, v * scale * recip), r, g, b);
+            out << r << ' ' << g << ' ' << b << '\n';
+        }
+        return white;
+    }
+
+    static void false_colour(double x, int& r, int& g, int& b) {
+        // Black, purple, red, orange, yellow, white at x = 0, 0.2, 0.4, 0.6, 0.8, 1.
+        static const double stops[6][3] = {
+            { 0, 0, 0 }, { 90, 20, 110 }, { 200, 30, 40 }, { 245, 120, 20 }, { 250, 220, 60 },
+            { 255, 255, 255 }
+        };
+        double f = x * 5;
+        int s = std::min(4, int(f));
+        f -= s;
+        r = int(stops[s][0] + (stops[s+1][0] - stops[s][0]) * f);
+        g = int(stops[s][1] + (stops[s+1][1] - stops[s][1]) * f);
+        b = int(stops[s][2] + (stops[s+1][2] - stops[s][2]) * f);
+    }
+
+    void write_pfm(const std::string& path, double scale) const {
+        // Portable float map: a text header, then little-endian floats (the negative scale says
+        // so), rows from the bottom of the image up.
+        std::ofstream out(path, std::ios::binary);
+        if (!out) {
+            std::cerr << "ERROR: cannot write " << path << ".\n";
+            return;
+        }
+        out << "PF\n" << width << ' ' << height << "\n-1.0\n";
+        std::vector<float> row(size_t(width) * 3);
+        for (int j = height - 1; j >= 0; j--) {
+            for (int i = 0; i < width; i++) {
+                size_t k = size_t(j) * width + i;
+                row[3*i]     = float(nodes[k] * scale);
+                row[3*i + 1] = float(tests[k] * scale);
+                row[3*i + 2] = float(nanoseconds[k] * scale);
+            }
+            out.write(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(float));
+        }
+    }
+};
+
+#endif
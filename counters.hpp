@@ -0,0 +1,265 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+// Traversal and render statistics for measuring changes to the acceleration structures and the
+// integrators. They are compiled in only with -DRT_COUNTERS; otherwise the RT_ macros below
+// expand to nothing and the hot loops carry no extra work.
+//
+// Every thread counts into its own thread_local copy, with plain adds. When a thread finishes its
+// share of a render, counter_report adds what it counted to the render's totals under a lock, and
+// counter_summary writes those totals out as JSON.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#if defined(RT_COUNTERS) && defined(__linux__)
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+    #include <cstring>
+#endif
+
+// The kinds of primitive counted by the exact intersection tests.
+enum class primitive_type { sphere, quad, triangle, medium, count };
+
+struct traversal_counters {
+    static const int bounce_bins = 64;  // The last bin holds every longer path
+
+    uint64_t rays = 0;              // Calls into the top-level hit test
+    uint64_t camera_rays = 0;       // Of which camera rays
+    uint64_t node_visits = 0;       // BVH nodes (bvh_node or flat_bvh) whose children were examined
+    uint64_t primitive_tests = 0;   // Primitives tested in flat_bvh leaves
+    uint64_t type_tests[int(primitive_type::count)] = {};  // Exact tests, by primitive_type
+    uint64_t bounces[bounce_bins] = {};     // Finished paths by number of scattering events
+    uint64_t render_ns = 0;         // Time in the integrator, intersection included
+    uint64_t intersect_ns = 0;      // Time in the top-level hit tests
+
+    traversal_counters& operator+=(const traversal_counters& c) { return combine(c, 1); }
+    traversal_counters& operator-=(const traversal_counters& c) { return combine(c, -1); }
+
+  private:
+    traversal_counters& combine(const traversal_counters& c, int sign) {
+        // Unsigned wrap-around makes sign -1 an exact subtraction.
+        uint64_t k = uint64_t(int64_t(sign));
+        rays += k * c.rays;
+        camera_rays += k * c.camera_rays;
+        node_visits += k * c.node_visits;
+        primitive_tests += k * c.primitive_tests;
+        for (int i = 0; i < int(primitive_type::count); i++)
+            type_tests[i] += k * c.type_tests[i];
+        for (int i = 0; i < bounce_bins; i++)
+            bounces[i] += k * c.bounces[i];
+        render_ns += k * c.render_ns;
+        intersect_ns += k * c.intersect_ns;
+        return *this;
+    }
+};
+
+#ifdef RT_COUNTERS
+    inline traversal_counters& thread_counters() {
+        thread_local traversal_counters counters;
+        return counters;
+    }
+
+    inline void count_bounces(int n) {
+        // Paths that were never traced come out negative and are not counted.
+        if (n >= 0)
+            thread_counters().bounces[std::min(n, traversal_counters::bounce_bins - 1)]++;
+    }
+
+    // Adds the time from its construction to its destruction to a field of the thread's counters.
+    class counter_timer {
+      public:
+        explicit counter_timer(uint64_t& field)
+          : field(field), start(std::chrono::steady_clock::now()) {}
+
+        ~counter_timer() {
+            field += uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count());
+        }
+
+      private:
+        uint64_t& field;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    #define RT_COUNT(field, n) (thread_counters().field += (n))
+    #define RT_COUNT_TEST(type) (thread_counters().type_tests[int(primitive_type::type)]++)
+    #define RT_COUNT_BOUNCES(n) count_bounces(n)
+    #define RT_TIME(field) counter_timer rt_timer_##field(thread_counters().field)
+#else
+    #define RT_COUNT(field, n) ((void)0)
+    #define RT_COUNT_TEST(type) ((void)0)
+    #define RT_COUNT_BOUNCES(n) ((void)0)
+    #define RT_TIME(field) ((void)0)
+#endif
+
+// Last-level cache misses of the calling thread, read from the Linux perf_event interface. On
+// other systems, or when the kernel does not allow it, available() is false and read() returns 0.
+class cache_miss_counter {
+  public:
+    cache_miss_counter() {
+    #if defined(RT_COUNTERS) && defined(__linux__)
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    #endif
+    }
+
+    ~cache_miss_counter() {
+    #if defined(RT_COUNTERS) && defined(__linux__)
+        if (fd >= 0) close(fd);
+    #endif
+    }
+
+    cache_miss_counter(const cache_miss_counter&) = delete;
+    cache_miss_counter& operator=(const cache_miss_counter&) = delete;
+
+    bool available() const { return fd >= 0; }
+
+    uint64_t read() const {
+        uint64_t value = 0;
+    #if defined(RT_COUNTERS) && defined(__linux__)
+        if (fd >= 0 && ::read(fd, &value, sizeof(value)) != sizeof(value))
+            value = 0;
+    #endif
+        return value;
+    }
+
+  private:
+    int fd = -1;
+};
+
+// The counters of all the threads of one render, summed, and their JSON summary.
+class counter_summary {
+  public:
+#ifdef RT_COUNTERS
+    static void begin() {
+        std::lock_guard<std::mutex> lock(mutex());
+        totals() = traversal_counters();
+    }
+
+    static void add(const traversal_counters& thread_share) {
+        std::lock_guard<std::mutex> lock(mutex());
+        totals() += thread_share;
+    }
+
+    // Writes the totals to `path`, with the image settings and the time taken to write the image
+    // (output_ns) that the counters themselves do not see. Thread times are summed over threads;
+    // shade time is what the integrator spent outside the top-level hit tests.
+    static void write(const std::string& path, int width, int height, int samples_per_pixel,
+                      int threads, uint64_t output_ns) {
+        std::lock_guard<std::mutex> lock(mutex());
+        const traversal_counters& c = totals();
+        uint64_t samples = uint64_t(width) * height * samples_per_pixel;
+        double per_ray = c.rays ? 1.0 / c.rays : 0.0;
+        const char* type_names[] = { "sphere", "quad", "triangle", "medium" };
+
+        int last_bin = traversal_counters::bounce_bins - 1;
+        while (last_bin > 0 && c.bounces[last_bin] == 0)
+            last_bin--;
+
+        std::ostringstream json;
+        json << "{\n"
+             << "  \"width\": " << width << ",\n"
+             << "  \"height\": " << height << ",\n"
+             << "  \"samples_per_pixel\": " << samples_per_pixel << ",\n"
+             << "  \"threads\": " << threads << ",\n"
+             << "  \"samples\": " << samples << ",\n"
+             << "  \"camera_rays\": " << c.camera_rays << ",\n"
+             << "  \"rays\": " << c.rays << ",\n"
+             << "  \"node_visits\": " << c.node_visits << ",\n"
+             << "  \"nodes_per_ray\": " << c.node_visits * per_ray << ",\n"
+             << "  \"leaf_tests\": " << c.primitive_tests << ",\n"
+             << "  \"primitive_tests\": {";
+        for (int i = 0; i < int(primitive_type::count); i++)
+            json << (i ? ", " : " ") << '"' << type_names[i] << "\": " << c.type_tests[i];
+        json << " },\n"
+             << "  \"bounces\": [";
+        for (int i = 0; i <= last_bin; i++)
+            json << (i ? ", " : "") << c.bounces[i];
+        json << "],\n"
+             << "  \"thread_ms\": { \"render\": " << c.render_ns * 1e-6
+             << ", \"intersect\": " << c.intersect_ns * 1e-6
+             << ", \"shade\": " << (c.render_ns - std::min(c.render_ns, c.intersect_ns)) * 1e-6
+             << " },\n"
+             << "  \"output_ms\": " << output_ns * 1e-6 << "\n"
+             << "}\n";
+
+        std::ofstream out(path);
+        if (!out) {
+            std::cerr << "ERROR: cannot write " << path << "; statistics follow.\n" << json.str();
+            return;
+        }
+        out << json.str();
+        std::clog << "Statistics written to " << path << "\n" << std::flush;
+    }
+
+  private:
+    static std::mutex& mutex() {
+        static std::mutex m;
+        return m;
+    }
+
+    static traversal_counters& totals() {
+        static traversal_counters c;
+        return c;
+    }
+#else
+    static void begin() {}
+    static void add(const traversal_counters&) {}
+    static void write(const std::string&, int, int, int, int, uint64_t) {}
+#endif
+};
+
+// Logs the traversal counters and cache misses of the calling thread between its construction and
+// its destruction, per ray, e.g. "rows 0-299: 1.2e+07 rays, 23.1 nodes/ray, ...", and adds them to
+// the counter_summary.
+class counter_report {
+  public:
+#ifdef RT_COUNTERS
+    counter_report(std::string label)
+      : label(std::move(label)), start(thread_counters()), start_misses(misses.read()) {}
+
+    ~counter_report() {
+        traversal_counters share = thread_counters();
+        share -= start;
+        counter_summary::add(share);
+
+        double rays = double(share.rays);
+        double per_ray = rays > 0 ? 1.0 / rays : 0.0;
+
+        std::ostringstream line;
+        line << label << ": " << rays << " rays, "
+             << share.node_visits * per_ray << " nodes/ray, "
+             << share.primitive_tests * per_ray << " primitive tests/ray, ";
+        if (misses.available())
+            line << (misses.read() - start_misses) * per_ray << " cache misses/ray\n";
+        else
+            line << "cache misses unavailable\n";
+        std::clog << line.str() << std::flush;
+    }
+
+  private:
+    std::string label;
+    traversal_counters start;
+    cache_miss_counter misses;
+    uint64_t start_misses;
+#else
+    counter_report(const std::string&) {}
+#endif
+};
+
+#endif
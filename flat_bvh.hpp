@@ -0,0 +1,334 @@
+#ifndef FLAT_BVH_H
+#define FLAT_BVH_H
+
+#include "utilis.hpp"
+#include "aabb.hpp"
+#include "counters.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// A compact BVH over primitives that are identified only by an integer id. Nodes are 32 bytes and
+// live in one flat array (the first child of an interior node directly follows it), leaves hold a
+// short run of primitive ids, and the tree is built with a binned SAH. Owners such as
+// triangle_mesh supply the per-primitive bounds at build time and the per-primitive hit test at
+// traversal time, so no hittable object is needed per primitive.
+class flat_bvh {
+  public:
+    // Float bounds of one primitive, used while building.
+    struct bounds3 {
+        float lo[3] = { +std::numeric_limits<float>::infinity(),
+                        +std::numeric_limits<float>::infinity(),
+                        +std::numeric_limits<float>::infinity() };
+        float hi[3] = { -std::numeric_limits<float>::infinity(),
+                        -std::numeric_limits<float>::infinity(),
+                        -std::numeric_limits<float>::infinity() };
+
+        bounds3() {}
+
+        bounds3(const aabb& box) {
+            // Round outwards so the float box always contains the double one.
+            for (int a = 0; a < 3; a++) {
+                const interval& ax = box.axis_interval(a);
+                lo[a] = std::nextafter(float(ax.min), -std::numeric_limits<float>::infinity());
+                hi[a] = std::nextafter(float(ax.max), +std::numeric_limits<float>::infinity());
+            }
+        }
+
+        void grow(const float p[3]) {
+            for (int a = 0; a < 3; a++) {
+                lo[a] = std::min(lo[a], p[a]);
+                hi[a] = std::max(hi[a], p[a]);
+            }
+        }
+
+        void grow(const bounds3& b) {
+            grow(b.lo);
+            grow(b.hi);
+        }
+
+        float half_area() const {
+            float dx = hi[0] - lo[0], dy = hi[1] - lo[1], dz = hi[2] - lo[2];
+            return (dx < 0) ? 0 : dx*dy + dy*dz + dz*dx;
+        }
+    };
+
+    flat_bvh() {}
+
+    flat_bvh(const std::vector<bounds3>& prim_bounds, int max_leaf_size = 4)
+      : max_leaf_size(max_leaf_size)
+    {
+        trace_span build("flat_bvh build", "scene");
+        size_t n = prim_bounds.size();
+        if (n == 0)
+            return;
+
+        std::vector<build_prim> prims(n);
+        for (size_t i = 0; i < n; i++) {
+            prims[i].bounds = prim_bounds[i];
+            for (int a = 0; a < 3; a++)
+                prims[i].centroid[a] = 0.5f * (prim_bounds[i].lo[a] + prim_bounds[i].hi[a]);
+        }
+
+        prim_ids.resize(n);
+        for (size_t i = 0; i < n; i++)
+            prim_ids[i] = uint32_t(i);
+
+        nodes.reserve(2 * n / max_leaf_size + 1);
+        build_recursive(prims, 0, uint32_t(n), 0);
+        nodes.shrink_to_fit();
+    }
+
+    bool empty() const { return nodes.empty(); }
+
+    aabb bounding_box() const {
+        if (nodes.empty())
+            return aabb::empty;
+        const node& root = nodes[0];
+        return aabb(point3(root.bmin[0], root.bmin[1], root.bmin[2]),
+                    point3(root.bmax[0], root.bmax[1], root.bmax[2]));
+    }
+
+    size_t memory_bytes() const {
+        return nodes.capacity() * sizeof(node) + prim_ids.capacity() * sizeof(uint32_t);
+    }
+
+    // Primitive ids in leaf order. A leaf covering [first, first + count) holds the primitives
+    // primitive_order()[first] ... primitive_order()[first + count - 1]; owners that want leaves to
+    // be contiguous in their own arrays can permute their data into this order after the build.
+    const std::vector<uint32_t>& primitive_order() const { return prim_ids; }
+
+    template <typename LeafFn>
+    bool traverse(const ray& r, interval& ray_t, const LeafFn& hit_prim) const {
+        // Walks the tree front to back. hit_prim(id, ray_t) tests one primitive against ray_t,
+        // and on a hit must shrink ray_t.max to the hit distance and return true.
+        return traverse_leaves(r, ray_t, [&](uint32_t first, uint32_t count, interval& t_range) {
+            bool hit_anything = false;
+            for (uint32_t i = 0; i < count; i++)
+                if (hit_prim(prim_ids[first + i], t_range))
+                    hit_anything = true;
+            return hit_anything;
+        });
+    }
+
+    template <typename LeafFn>
+    bool traverse_leaves(const ray& r, interval& ray_t, const LeafFn& hit_leaf) const {
+        // As traverse(), but hands over whole leaves: hit_leaf(first, count, ray_t) tests the
+        // leaf's primitives (see primitive_order()) at once, for owners that test them in SIMD.
+        if (nodes.empty())
+            return false;
+
+        const ray_box rb(r);
+        bool hit_anything = false;
+
+        // Deferred subtrees, together with the distance at which the ray enters their box.
+        struct stack_entry { uint32_t node; float t_entry; };
+        stack_entry stack[max_depth];
+        int stack_size = 0;
+        stack[stack_size++] = { 0, float(ray_t.min) };
+
+        while (stack_size > 0) {
+            const stack_entry entry = stack[--stack_size];
+            if (entry.t_entry > ray_t.max)
+                continue;   // The subtree starts beyond the closest hit found so far.
+
+            uint32_t node_index = entry.node;
+            while (true) {
+                const node& n = nodes[node_index];
+                RT_COUNT(node_visits, 1);
+
+                if (n.count > 0) {
+                    RT_COUNT(primitive_tests, n.count);
+                    if (hit_leaf(n.offset, n.count, ray_t))
+                        hit_anything = true;
+                    break;
+                }
+
+                // Descend into the child the ray enters first and defer the other one.
+                uint32_t near_child = node_index + 1;
+                uint32_t far_child  = n.offset;
+                float t_near, t_far;
+                bool hit_near = nodes[near_child].hit(rb, ray_t, t_near);
+                bool hit_far  = nodes[far_child].hit(rb, ray_t, t_far);
+
+                if (hit_near && hit_far) {
+                    if (t_far < t_near) {
+                        std::swap(near_child, far_child);
+                        std::swap(t_near, t_far);
+                    }
+                    stack[stack_size++] = { far_child, t_far };
+                    node_index = near_child;
+                } else if (hit_near || hit_far) {
+                    node_index = hit_near ? near_child : far_child;
+                } else {
+                    break;
+                }
+            }
+        }
+
+        return hit_anything;
+    }
+
+  private:
+    // Per-ray values for the slab test, computed once per traversal.
+    struct ray_box {
+        float org[3];
+        float inv_dir[3];
+
+        ray_box(const ray& r) {
+            for (int a = 0; a < 3; a++) {
+                org[a] = float(r.origin()[a]);
+                // Keep the reciprocal finite so that 0 * inv_dir never produces a NaN.
+                double d = r.direction()[a];
+                double da = std::fabs(d) < 1e-30 ? std::copysign(1e-30, d) : d;
+                inv_dir[a] = float(1.0 / da);
+            }
+        }
+    };
+
+    struct node {
+        float bmin[3];
+        float bmax[3];
+        uint32_t offset;    // Leaf: first entry in prim_ids. Interior: index of the second child.
+        uint32_t count;     // Leaf: number of primitives. Interior: 0.
+
+        bool hit(const ray_box& rb, const interval& ray_t, float& t_entry) const {
+            float t_min = float(ray_t.min);
+            float t_max = float(ray_t.max);
+            for (int a = 0; a < 3; a++) {
+                float t0 = (bmin[a] - rb.org[a]) * rb.inv_dir[a];
+                float t1 = (bmax[a] - rb.org[a]) * rb.inv_dir[a];
+                if (t0 > t1) std::swap(t0, t1);
+                // Widen the far slab slightly so float rounding cannot cull a real hit.
+                t1 *= 1.0f + 2e-7f * 6;
+                t_min = t0 > t_min ? t0 : t_min;
+                t_max = t1 < t_max ? t1 : t_max;
+                if (t_max < t_min)
+                    return false;
+            }
+            t_entry = t_min;
+            return true;
+        }
+    };
+
+    struct build_prim {
+        bounds3 bounds;
+        float centroid[3];
+    };
+
+    static const int bin_count = 12;
+    static const int max_depth = 128;       // Also the size of the traversal stack
+
+    int max_leaf_size = 4;
+    std::vector<node> nodes;
+    std::vector<uint32_t> prim_ids;
+
+    uint32_t build_recursive(const std::vector<build_prim>& prims, uint32_t start, uint32_t end,
+                             int depth) {
+        uint32_t node_index = uint32_t(nodes.size());
+        nodes.emplace_back();
+
+        bounds3 bounds, centroid_bounds;
+        for (uint32_t i = start; i < end; i++) {
+            bounds.grow(prims[prim_ids[i]].bounds);
+            centroid_bounds.grow(prims[prim_ids[i]].centroid);
+        }
+
+        auto set_bounds = [&](node& n) {
+            std::copy(bounds.lo, bounds.lo + 3, n.bmin);
+            std::copy(bounds.hi, bounds.hi + 3, n.bmax);
+        };
+
+        uint32_t count = end - start;
+        if (count <= uint32_t(max_leaf_size)) {
+            node& leaf = nodes[node_index];
+            set_bounds(leaf);
+            leaf.offset = start;
+            leaf.count = count;
+            return node_index;
+        }
+
+        // Binned SAH over the centroid extent of the longest centroid axis.
+        int axis = 0;
+        for (int a = 1; a < 3; a++)
+            if (centroid_bounds.hi[a] - centroid_bounds.lo[a]
+                > centroid_bounds.hi[axis] - centroid_bounds.lo[axis])
+                axis = a;
+
+        float extent = centroid_bounds.hi[axis] - centroid_bounds.lo[axis];
+        uint32_t mid = start;
+
+        // Past half the depth budget, only balanced median splits are used, so the tree can never
+        // outgrow the traversal stack.
+        if (extent > 0 && depth < max_depth / 2) {
+            bounds3 bin_bounds[bin_count];
+            uint32_t bin_counts[bin_count] = {};
+            float scale = bin_count / extent;
+            auto bin_of = [&](uint32_t prim) {
+                int b = int((prims[prim].centroid[axis] - centroid_bounds.lo[axis]) * scale);
+                return std::min(b, bin_count - 1);
+            };
+
+            for (uint32_t i = start; i < end; i++) {
+                int b = bin_of(prim_ids[i]);
+                bin_counts[b]++;
+                bin_bounds[b].grow(prims[prim_ids[i]].bounds);
+            }
+
+            // Sweep from the right to get the cost of every right-hand partition, then from the
+            // left to find the split with the lowest total cost.
+            float right_cost[bin_count];
+            bounds3 acc;
+            uint32_t acc_count = 0;
+            for (int b = bin_count - 1; b > 0; b--) {
+                acc.grow(bin_bounds[b]);
+                acc_count += bin_counts[b];
+                right_cost[b] = acc.half_area() * acc_count;
+            }
+
+            int best_split = -1;
+            float best_cost = std::numeric_limits<float>::infinity();
+            acc = bounds3();
+            acc_count = 0;
+            for (int b = 0; b < bin_count - 1; b++) {
+                acc.grow(bin_bounds[b]);
+                acc_count += bin_counts[b];
+                float cost = acc.half_area() * acc_count + right_cost[b + 1];
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_split = b;
+                }
+            }
+
+            if (best_split >= 0) {
+                auto split = std::partition(prim_ids.begin() + start, prim_ids.begin() + end,
+                                            [&](uint32_t prim) { return bin_of(prim) <= best_split; });
+                mid = uint32_t(split - prim_ids.begin());
+            }
+        }
+
+        if (mid == start || mid == end) {
+            // Degenerate centroids or no useful SAH split: fall back to a median split.
+            mid = start + count / 2;
+            std::nth_element(prim_ids.begin() + start, prim_ids.begin() + mid,
+                             prim_ids.begin() + end,
+                             [&](uint32_t a, uint32_t b) {
+                                 return prims[a].centroid[axis] < prims[b].centroid[axis];
+                             });
+        }
+
+        build_recursive(prims, start, mid, depth + 1);
+        uint32_t second = build_recursive(prims, mid, end, depth + 1);
+
+        node& n = nodes[node_index];
+        set_bounds(n);
+        n.offset = second;
+        n.count = 0;
+        return node_index;
+    }
+};
+
+#endif
@@ -0,0 +1,264 @@
+#ifndef GRID_MEDIUM_H
+#define GRID_MEDIUM_H
+
+#include "hittable.hpp"
+#include "material.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Voxel densities stored in bricks of 8x8x8, with the all-zero bricks left out, so that the empty
+// space around smoke or a cloud costs one index per brick. Values between voxel centres are
+// interpolated trilinearly, and each brick also keeps the largest value interpolation can reach
+// inside it (its majorant), which makes the brick grid the coarse majorant grid of grid_medium.
+class density_grid {
+  public:
+    static const int brick_size = 8;
+
+    density_grid() {}
+
+    // `values` holds nx * ny * nz densities, x fastest, then y, then z.
+    density_grid(int nx, int ny, int nz, const std::vector<float>& values)
+      : nx(nx), ny(ny), nz(nz),
+        bx((nx + brick_size - 1) / brick_size),
+        by((ny + brick_size - 1) / brick_size),
+        bz((nz + brick_size - 1) / brick_size)
+    {
+        if (nx <= 0 || ny <= 0 || nz <= 0 || values.size() != size_t(nx) * ny * nz) {
+            std::cerr << "ERROR: density_grid needs nx * ny * nz values; the grid is empty.\n";
+            this->nx = this->ny = this->nz = 0;
+            bx = by = bz = 0;
+            return;
+        }
+
+        const int brick_voxels = brick_size * brick_size * brick_size;
+        brick_index.assign(size_t(bx) * by * bz, -1);
+        for (int b = 0; b < bx * by * bz; b++) {
+            int x0 = (b % bx) * brick_size, y0 = (b / bx % by) * brick_size;
+            int z0 = (b / (bx * by)) * brick_size;
+
+            std::vector<float> brick(brick_voxels, 0.0f);
+            bool empty = true;
+            for (int z = 0; z < brick_size; z++)
+                for (int y = 0; y < brick_size; y++)
+                    for (int x = 0; x < brick_size; x++) {
+                        if (x0 + x >= nx || y0 + y >= ny || z0 + z >= nz)
+                            continue;
+                        float v = values[(size_t(z0 + z) * ny + (y0 + y)) * nx + (x0 + x)];
+                        brick[(z * brick_size + y) * brick_size + x] = v;
+                        empty = empty && v == 0;
+                    }
+            if (empty)
+                continue;
+            brick_index[b] = int32_t(bricks.size() / brick_voxels);
+            bricks.insert(bricks.end(), brick.begin(), brick.end());
+        }
+
+        // A brick's majorant also covers the voxels one step outside it, which trilinear
+        // interpolation blends in near its faces.
+        majorants.assign(size_t(bx) * by * bz, 0.0f);
+        for (int b = 0; b < bx * by * bz; b++) {
+            int x0 = (b % bx) * brick_size, y0 = (b / bx % by) * brick_size;
+            int z0 = (b / (bx * by)) * brick_size;
+            float m = 0;
+            for (int z = z0 - 1; z <= z0 + brick_size; z++)
+                for (int y = y0 - 1; y <= y0 + brick_size; y++)
+                    for (int x = x0 - 1; x <= x0 + brick_size; x++)
+                        m = std::max(m, voxel(x, y, z));
+            majorants[b] = m;
+        }
+    }
+
+    int size_x() const { return nx; }
+    int size_y() const { return ny; }
+    int size_z() const { return nz; }
+    int bricks_x() const { return bx; }
+    int bricks_y() const { return by; }
+    int bricks_z() const { return bz; }
+
+    float voxel(int x, int y, int z) const {
+        // Clamped to the edge of the grid.
+        x = std::clamp(x, 0, nx - 1);
+        y = std::clamp(y, 0, ny - 1);
+        z = std::clamp(z, 0, nz - 1);
+        int b = brick_index[(size_t(z / brick_size) * by + y / brick_size) * bx + x / brick_size];
+        if (b < 0)
+            return 0;
+        const int m = brick_size - 1;
+        return bricks[size_t(b) * brick_size * brick_size * brick_size
+                      + ((z & m) * brick_size + (y & m)) * brick_size + (x & m)];
+    }
+
+    double value(double x, double y, double z) const {
+        // Trilinear density at (x, y, z) in voxel units, voxel (i, j, k) being centred at
+        // (i + 0.5, j + 0.5, k + 0.5).
+        x -= 0.5; y -= 0.5; z -= 0.5;
+        int i = int(std::floor(x)), j = int(std::floor(y)), k = int(std::floor(z));
+        double fx = x - i, fy = y - j, fz = z - k;
+
+        double c00 = voxel(i, j,   k)   * (1 - fx) + voxel(i+1, j,   k)   * fx;
+        double c10 = voxel(i, j+1, k)   * (1 - fx) + voxel(i+1, j+1, k)   * fx;
+        double c01 = voxel(i, j,   k+1) * (1 - fx) + voxel(i+1, j,   k+1) * fx;
+        double c11 = voxel(i, j+1, k+1) * (1 - fx) + voxel(i+1, j+1, k+1) * fx;
+        double c0 = c00 * (1 - fy) + c10 * fy;
+        double c1 = c01 * (1 - fy) + c11 * fy;
+        return c0 * (1 - fz) + c1 * fz;
+    }
+
+    float majorant(int brick_x, int brick_y, int brick_z) const {
+        return majorants[(size_t(brick_z) * by + brick_y) * bx + brick_x];
+    }
+
+    size_t stored_bricks() const {
+        return bricks.size() / (brick_size * brick_size * brick_size);
+    }
+
+    size_t memory_bytes() const {
+        return bricks.capacity() * sizeof(float) + brick_index.capacity() * sizeof(int32_t)
+             + majorants.capacity() * sizeof(float);
+    }
+
+  private:
+    int nx = 0, ny = 0, nz = 0;         // Voxels
+    int bx = 0, by = 0, bz = 0;         // Bricks
+    std::vector<float> bricks;          // The stored bricks, brick_size^3 values each
+    std::vector<int32_t> brick_index;   // Per brick: its place in `bricks`, or -1 if all zero
+    std::vector<float> majorants;       // Per brick: the largest interpolated density in it
+};
+
+// A participating medium whose density varies over a voxel grid filling `bounds`. Distances to
+// the next scattering event are sampled by delta tracking against the brick majorants: tentative
+// collisions are drawn at the majorant's rate, and each is accepted with probability density /
+// majorant. A 3D DDA walks the bricks along the ray and skips empty ones outright, so the cost of
+// a ray grows with the optical depth it crosses, not with the size of the box.
+class grid_medium : public hittable {
+  public:
+    // sigma_t = density_scale * grid density, per world unit.
+    grid_medium(const aabb& bounds, density_grid grid, double density_scale, const color& albedo)
+      : bounds(bounds), grid(std::move(grid)), density_scale(density_scale),
+        phase_function(make_shared<isotropic>(albedo))
+    {}
+
+    grid_medium(const aabb& bounds, density_grid grid, double density_scale,
+                shared_ptr<texture> tex)
+      : bounds(bounds), grid(std::move(grid)), density_scale(density_scale),
+        phase_function(make_shared<isotropic>(tex))
+    {}
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        RT_COUNT_TEST(medium);
+        bool collided = false;
+        walk_bricks(r, ray_t, [&](double t0, double t1, double sigma_bar, const grid_ray& g) {
+            // Delta tracking inside one brick of constant majorant sigma_bar (per unit of t).
+            for (double t = t0;;) {
+                t -= std::log(1 - sample_1d()) / sigma_bar;
+                if (t >= t1)
+                    return false;
+                if (g.density(grid, t) * density_scale > sample_1d() * sigma_bar / g.length) {
+                    rec.t = t;
+                    collided = true;
+                    return true;
+                }
+            }
+        });
+        if (!collided)
+            return false;
+
+        rec.p = r.at(rec.t);
+        rec.normal = vec3(1,0,0);  // arbitrary
+        rec.front_face = true;     // also arbitrary
+        rec.deferred_uv = nullptr;
+        rec.mat = phase_function;
+        return true;
+    }
+
+    aabb bounding_box() const override { return bounds; }
+
+    const density_grid& density() const { return grid; }
+
+    size_t memory_bytes() const { return grid.memory_bytes(); }
+
+  private:
+    aabb bounds;
+    density_grid grid;
+    double density_scale;
+    shared_ptr<material> phase_function;
+
+    // The ray in voxel units: position o + t d at the ray's own parameter t.
+    struct grid_ray {
+        double o[3], d[3];
+        double length;          // |r.direction()|, world units per unit of t
+
+        double density(const density_grid& grid, double t) const {
+            return grid.value(o[0] + t * d[0], o[1] + t * d[1], o[2] + t * d[2]);
+        }
+    };
+
+    template <typename BrickFn>
+    void walk_bricks(const ray& r, interval ray_t, const BrickFn& brick_fn) const {
+        // Calls brick_fn(t0, t1, sigma_bar, g) for the non-empty bricks along r within ray_t,
+        // front to back, where sigma_bar is the brick's majorant extinction per unit of t. Stops
+        // when brick_fn returns true.
+        if (grid.bricks_x() == 0)
+            return;
+
+        // Clip to the box.
+        for (int a = 0; a < 3; a++) {
+            const interval& ax = bounds.axis_interval(a);
+            double inv_d = 1.0 / r.direction()[a];
+            double t0 = (ax.min - r.origin()[a]) * inv_d;
+            double t1 = (ax.max - r.origin()[a]) * inv_d;
+            if (t0 > t1) std::swap(t0, t1);
+            ray_t.min = std::max<double>(ray_t.min, t0);
+            ray_t.max = std::min<double>(ray_t.max, t1);
+        }
+        if (!(ray_t.min < ray_t.max))
+            return;
+
+        const int counts[3] = { grid.size_x(), grid.size_y(), grid.size_z() };
+        const int bricks[3] = { grid.bricks_x(), grid.bricks_y(), grid.bricks_z() };
+        const double B = density_grid::brick_size;
+
+        grid_ray g;
+        g.length = r.direction().length();
+        int cell[3], step[3];
+        double t_next[3], t_delta[3];
+        for (int a = 0; a < 3; a++) {
+            const interval& ax = bounds.axis_interval(a);
+            double voxels_per_unit = counts[a] / ax.size();
+            g.o[a] = (r.origin()[a] - ax.min) * voxels_per_unit;
+            g.d[a] = r.direction()[a] * voxels_per_unit;
+
+            double entry = g.o[a] + ray_t.min * g.d[a];
+            cell[a] = std::clamp(int(std::floor(entry / B)), 0, bricks[a] - 1);
+            step[a] = g.d[a] > 0 ? 1 : -1;
+            if (g.d[a] == 0) {
+                t_next[a] = t_delta[a] = infinity;
+            } else {
+                double boundary = (cell[a] + (step[a] > 0 ? 1 : 0)) * B;
+                t_next[a] = (boundary - g.o[a]) / g.d[a];
+                t_delta[a] = B / std::fabs(g.d[a]);
+            }
+        }
+
+        const double sigma_per_density = density_scale * g.length;
+        double t = ray_t.min;
+        while (t < ray_t.max) {
+            int a = t_next[0] < t_next[1] ? (t_next[0] < t_next[2] ? 0 : 2)
+                                          : (t_next[1] < t_next[2] ? 1 : 2);
+            double t_exit = std::min<double>(t_next[a], ray_t.max);
+
+            double sigma_bar = grid.majorant(cell[0], cell[1], cell[2]) * sigma_per_density;
+            if (sigma_bar > 0 && t_exit > t && brick_fn(t, t_exit, sigma_bar, g))
+                return;
+
+            t = t_exit;
+            cell[a] += step[a];
+            t_next[a] += t_delta[a];
+            if (cell[a] < 0 || cell[a] >= bricks[a])
+                return;
+        }
+    }
+};
+
+#endif
@@ -3,19 +3,54 @@
 
 #include "utilis.hpp"
 #include "aabb.hpp"
+#include "affine.hpp"
+#include "ray_packet.hpp"
+#include "counters.hpp"
 
 class material; 
+class hittable;
 
 class hit_record{
   public:
     point3 p;
     vec3 normal;
     shared_ptr<material> mat;
-    double t;
-    double u;
-    double v;
+    real t;
+    real u;
+    real v;
     bool front_face;
 
+    // Shapes whose UVs are costly (spheres) set this instead of u and v, and surface_uv() calls it
+    // once a texture actually reads them, i.e. only for the closest hit and only if the material
+    // needs UVs. Every other shape fills u and v and sets it to null.
+    void (*deferred_uv)(const hit_record& rec, real& u, real& v) = nullptr;
+
+    // Set by hittable::intersect() when only t and the two fields below are filled in; finish()
+    // has `pending` compute the rest. Null once the record is complete.
+    const hittable* pending = nullptr;
+    uint32_t prim = 0;          // Which primitive of `pending` was hit, e.g. a triangle index
+    real b1 = 0, b2 = 0;        // Where on that primitive, e.g. barycentric coordinates
+    // When `pending` is a transform: the object inside it whose hit is still pending, in object
+    // space, or null if only the transform's own mapping back to world space is left.
+    const hittable* pending_inner = nullptr;
+
+    void finish(const ray& r);
+
+    void surface_uv(real& u_out, real& v_out) const {
+        if (deferred_uv) {
+            deferred_uv(*this, u_out, v_out);
+        } else {
+            u_out = u;
+            v_out = v;
+        }
+    }
+
+    void resolve_uv() {
+        // Computes deferred UVs now, for callers about to change the frame of the normal.
+        surface_uv(u, v);
+        deferred_uv = nullptr;
+    }
+
     void set_face_normal(const ray& r, const vec3& outward_normal){
         // Sets the hit record normal vector.
         // NOTE: the parameter `outward_normal` is assumed to have unit length.
@@ -30,6 +65,29 @@ class hittable{
   public:
     virtual ~hittable() = default;
     virtual bool hit(const ray&r, interval ray_t, hit_record& rec) const = 0;
+
+    // hit() without the shading data: finds the closest hit in ray_t and sets rec.t, but may
+    // leave the rest of the record pending (see hit_record::pending) until finish(). Aggregates
+    // call it on their children so that p, the normal and the material are computed once, for
+    // the hit that wins, rather than for every closer hit found on the way. The default is the
+    // full hit().
+    virtual bool intersect(const ray& r, interval ray_t, hit_record& rec) const {
+        if (!hit(r, ray_t, rec))
+            return false;
+        rec.pending = nullptr;
+        return true;
+    }
+
+    // Completes a record that this object's intersect() left pending, for the same ray.
+    virtual void finish_hit(const ray& r, hit_record& rec) const {}
+
+    // Closed convex objects (spheres, boxes, and those under a transform) return true from
+    // is_convex() and answer convex_span(): the range of t, over the whole line of r, for which
+    // r is inside the object, i.e. the entry and the exit in one query. It returns false if r
+    // misses. Media bounded by such an object use it in place of two hit() calls.
+    virtual bool is_convex() const { return false; }
+    virtual bool convex_span(const ray& r, interval& inside) const { return false; }
+
     virtual aabb bounding_box() const = 0;
     virtual double pdf_value(const point3& origin, const vec3& direction) const {
         return 0.0;
@@ -39,118 +97,168 @@ class hittable{
         return vec3(1,0,0);
     }
 
-  private:
+    // Intersects the rays of `packet` picked out by `mask` against [t_min[i], t_max[i]]. Each
+    // ray that hits fills recs[i] and lowers its t_max; the returned mask says which rays hit.
+    // The default traces the rays one at a time; acceleration structures and simple shapes
+    // override it to share work across the packet.
+    virtual uint64_t hit_packet(ray_packet& packet, uint64_t mask, hit_record* recs) const {
+        uint64_t hits = 0;
+        for (; mask; mask &= mask - 1) {
+            int i = ray_packet::lowest(mask);
+            if (hit(packet.rays[i], interval(packet.t_min[i], packet.t_max[i]), recs[i])) {
+                packet.set_t_max(i, recs[i].t);
+                hits |= uint64_t(1) << i;
+            }
+        }
+        return hits;
+    }
 
+  protected:
+    // hit() for objects that override intersect().
+    bool intersect_and_finish(const ray& r, interval ray_t, hit_record& rec) const {
+        if (!intersect(r, ray_t, rec))
+            return false;
+        rec.finish(r);
+        return true;
+    }
 };
 
-class translate : public hittable {
+inline void hit_record::finish(const ray& r) {
+    if (!pending)
+        return;
+    const hittable* object = pending;
+    pending = nullptr;
+    object->finish_hit(r, *this);
+}
+
+// An object placed in the world by an affine transform. The matrix and its inverse are computed
+// once, so each ray costs one matrix multiply on the way in, whatever chain of translations,
+// rotations and scalings produced it. Wrapping a transform in another transform folds the two
+// matrices together instead of adding a layer.
+class transform : public hittable {
   public:
-    translate(shared_ptr<hittable> object, const vec3& offset)
-      : object(object), offset(offset)
+    transform(shared_ptr<hittable> object, const affine& object_to_world)
+      : object(object), object_to_world(object_to_world)
     {
-        bbox = object->bounding_box() + offset;
+        if (auto inner = std::dynamic_pointer_cast<transform>(object)) {
+            this->object = inner->object;
+            this->object_to_world = object_to_world * inner->object_to_world;
+        }
+        world_to_object = this->object_to_world.inverse();
+        bbox = this->object_to_world.transform_box(this->object->bounding_box());
+        ray_packet::float_box(bbox, box_min, box_max);
     }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        // Move the ray backwards by the offset
-        ray offset_r(r.origin() - offset, r.direction(), r.time());
+        return intersect_and_finish(r, ray_t, rec);
+    }
 
-        // Determine whether an intersection exists along the offset ray (and if so, where)
-        if (!object->hit(offset_r, ray_t, rec))
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        // The object-space direction is not renormalised, so rec.t is valid in both spaces.
+        // The object's hit is left pending behind this transform, and finish_hit() completes it
+        // and maps it back. A record keeps one pending_inner, so a transform nested below this
+        // one (under an aggregate) is finished here, in object space, straight away.
+        const ray local = world_to_object.transform_ray(r);
+        const hittable* outer_inner = rec.pending_inner;
+        rec.pending_inner = nullptr;
+        if (!object->intersect(local, ray_t, rec)) {
+            rec.pending_inner = outer_inner;    // A miss leaves the record as it was
             return false;
-
-        // Move the intersection point forwards by the offset
-        rec.p += offset;
-
+        }
+        if (rec.pending_inner)
+            rec.finish(local);
+        rec.pending_inner = rec.pending;
+        rec.pending = this;
         return true;
     }
-    aabb bounding_box() const override { return bbox; }
-
-  private:
-    shared_ptr<hittable> object;
-    vec3 offset;
-    aabb bbox;
-};
 
-class rotate_y : public hittable {
-  public:
-     rotate_y(shared_ptr<hittable> object, double angle) : object(object) {
-        auto radians = degrees_to_radians(angle);
-        sin_theta = std::sin(radians);
-        cos_theta = std::cos(radians);
-        bbox = object->bounding_box();
-
-        point3 min( infinity,  infinity,  infinity);
-        point3 max(-infinity, -infinity, -infinity);
-
-        for (int i = 0; i < 2; i++) {
-            for (int j = 0; j < 2; j++) {
-                for (int k = 0; k < 2; k++) {
-                    auto x = i*bbox.x.max + (1-i)*bbox.x.min;
-                    auto y = j*bbox.y.max + (1-j)*bbox.y.min;
-                    auto z = k*bbox.z.max + (1-k)*bbox.z.min;
-
-                    auto newx =  cos_theta*x + sin_theta*z;
-                    auto newz = -sin_theta*x + cos_theta*z;
-
-                    vec3 tester(newx, y, newz);
-
-                    for (int c = 0; c < 3; c++) {
-                        min[c] = std::fmin(min[c], tester[c]);
-                        max[c] = std::fmax(max[c], tester[c]);
-                    }
-                }
-            }
+    void finish_hit(const ray& r, hit_record& rec) const override {
+        if (rec.pending_inner) {
+            rec.pending = rec.pending_inner;
+            rec.pending_inner = nullptr;
+            rec.finish(world_to_object.transform_ray(r));
         }
 
-        bbox = aabb(min, max);
+        // Normals go back through the inverse transpose, which keeps them perpendicular to the
+        // surface under non-uniform scaling and keeps front_face consistent with the world ray.
+        // Deferred UVs are taken from the object-space normal, so compute them first.
+        rec.resolve_uv();
+        rec.p = r.at(rec.t);
+        rec.normal = unit_vector(world_to_object.transform_transposed(rec.normal));
     }
-    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
 
-        // Transform the ray from world space to object space.
+    uint64_t hit_packet(ray_packet& packet, uint64_t mask, hit_record* recs) const override {
+        // Moves the rays that reach the bounding box into object space, each in its own lane.
+        mask = packet.hits_box(box_min, box_max, mask);
+        if (!mask)
+            return 0;
+
+        ray_packet local;
+        local.size = packet.size;
+        for (uint64_t m = mask; m; m &= m - 1) {
+            int i = ray_packet::lowest(m);
+            local.set(i, world_to_object.transform_ray(packet.rays[i]),
+                      interval(packet.t_min[i], packet.t_max[i]));
+        }
 
-        auto origin = point3(
-            (cos_theta * r.origin().x()) - (sin_theta * r.origin().z()),
-            r.origin().y(),
-            (sin_theta * r.origin().x()) + (cos_theta * r.origin().z())
-        );
+        uint64_t hits = object->hit_packet(local, mask, recs);
+        for (uint64_t m = hits; m; m &= m - 1) {
+            int i = ray_packet::lowest(m);
+            recs[i].resolve_uv();
+            recs[i].p = packet.rays[i].at(recs[i].t);
+            recs[i].normal = unit_vector(world_to_object.transform_transposed(recs[i].normal));
+            packet.set_t_max(i, recs[i].t);
+        }
+        return hits;
+    }
 
-        auto direction = vec3(
-            (cos_theta * r.direction().x()) - (sin_theta * r.direction().z()),
-            r.direction().y(),
-            (sin_theta * r.direction().x()) + (cos_theta * r.direction().z())
-        );
+    bool is_convex() const override { return object->is_convex(); }
 
-        ray rotated_r(origin, direction, r.time());
+    bool convex_span(const ray& r, interval& inside) const override {
+        // Affine maps keep convex objects convex, and t is the same in both spaces.
+        return object->convex_span(world_to_object.transform_ray(r), inside);
+    }
 
-        // Determine whether an intersection exists in object space (and if so, where).
+    aabb bounding_box() const override { return bbox; }
 
-        if (!object->hit(rotated_r, ray_t, rec))
-            return false;
+  private:
+    shared_ptr<hittable> object;
+    affine object_to_world;
+    affine world_to_object;
+    aabb bbox;
+    float box_min[3], box_max[3];   // bbox for packet tests
+};
 
-        // Transform the intersection from object space back to world space.
+// The classic wrappers are now just named ways to build a transform, so a chain such as
+// translate(rotate_y(box, 15), offset) collapses into a single matrix at scene-build time.
+class translate : public transform {
+  public:
+    translate(shared_ptr<hittable> object, const vec3& offset)
+      : transform(object, affine::translation(offset)) {}
+};
 
-        rec.p = point3(
-            (cos_theta * rec.p.x()) + (sin_theta * rec.p.z()),
-            rec.p.y(),
-            (-sin_theta * rec.p.x()) + (cos_theta * rec.p.z())
-        );
+class rotate_x : public transform {
+  public:
+    rotate_x(shared_ptr<hittable> object, double angle)
+      : transform(object, affine::rotation(vec3(1,0,0), angle)) {}
+};
 
-        rec.normal = vec3(
-            (cos_theta * rec.normal.x()) + (sin_theta * rec.normal.z()),
-            rec.normal.y(),
-            (-sin_theta * rec.normal.x()) + (cos_theta * rec.normal.z())
-        );
+class rotate_y : public transform {
+  public:
+    rotate_y(shared_ptr<hittable> object, double angle)
+      : transform(object, affine::rotation(vec3(0,1,0), angle)) {}
+};
 
-        return true;
-    }
-    aabb bounding_box() const override { return bbox; }
+class rotate_z : public transform {
+  public:
+    rotate_z(shared_ptr<hittable> object, double angle)
+      : transform(object, affine::rotation(vec3(0,0,1), angle)) {}
+};
 
-  private:
-    shared_ptr<hittable> object;
-    double sin_theta;
-    double cos_theta;
-    aabb bbox;
+class scale : public transform {
+  public:
+    scale(shared_ptr<hittable> object, const vec3& factors)
+      : transform(object, affine::scaling(factors)) {}
 };
 
 #endif
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include "aabb.hpp"
 #include "hittable.hpp"
+#include <algorithm>
 #include <vector>
 
 using std::make_shared;
@@ -23,21 +24,33 @@ class hittable_list : public hittable{
     }
 
     bool hit (const ray& r, interval ray_t, hit_record& rec) const override{
-        hit_record temp_rec;
+        return intersect_and_finish(r, ray_t, rec);
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        // Objects only fill in t until the closest one is known, so each closer hit can go
+        // straight into rec.
         bool hit_any = false;
-        double closest_so_far = ray_t.max;
+        real closest_so_far = ray_t.max;
         for (const auto& object : objects){
-            if (object->hit(r, interval( ray_t.min, closest_so_far), temp_rec)){
+            if (object->intersect(r, interval( ray_t.min, closest_so_far), rec)){
                 hit_any = true;
 
                 // 把目前距離光線位置記住
-                closest_so_far = temp_rec.t;
-                rec = temp_rec;
+                closest_so_far = rec.t;
             }
         }
         return hit_any;
     }
 
+    uint64_t hit_packet(ray_packet& packet, uint64_t mask, hit_record* recs) const override {
+        // Object by object for the whole packet; every ray keeps its own closest hit.
+        uint64_t hits = 0;
+        for (const auto& object : objects)
+            hits |= object->hit_packet(packet, mask, recs);
+        return hits;
+    }
+
     aabb bounding_box() const override { return bbox; }
     
     double pdf_value(const point3& origin, const vec3& direction) const override {
@@ -52,7 +65,8 @@ class hittable_list : public hittable{
 
     vec3 random(const point3& origin) const override {
         auto int_size = int(objects.size());
-        return objects[random_int(0, int_size-1)]->random(origin);
+        int pick = std::min(int(int_size * sample_1d()), int_size - 1);
+        return objects[pick]->random(origin);
     }
 
 
@@ -0,0 +1,60 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "hittable.hpp"
+#include "flat_bvh.hpp"
+#include <vector>
+
+// One placement of a shared object (the bottom level, e.g. a triangle_mesh or a bvh_node) in the
+// world. It is a transform under another name: the object is shared by every instance that
+// points at it, and the instance itself owns only the two matrices and its bounds.
+class instance : public transform {
+  public:
+    using transform::transform;
+};
+
+// The top level of a two-level acceleration structure: a flat_bvh over instances stored by value.
+// Each instance's object carries its own acceleration structure (the bottom level), which is
+// built once and reused by every instance of it.
+class instance_bvh : public hittable {
+  public:
+    instance_bvh(std::vector<instance> instances) : instances(std::move(instances)) {
+        std::vector<flat_bvh::bounds3> bounds;
+        bounds.reserve(this->instances.size());
+        for (const auto& inst : this->instances)
+            bounds.emplace_back(inst.bounding_box());
+
+        bvh = flat_bvh(bounds, 2);
+        bbox = bvh.bounding_box();
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return intersect_and_finish(r, ray_t, rec);
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        // The closest instance's hit stays pending, and is finished once by the caller.
+        return bvh.traverse(r, ray_t, [&](uint32_t id, interval& t_range) {
+            if (!instances[id].intersect(r, t_range, rec))
+                return false;
+            t_range.max = rec.t;
+            return true;
+        });
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    size_t instance_count() const { return instances.size(); }
+
+    size_t memory_bytes() const {
+        // Bytes used by the top level only; shared objects are not counted.
+        return instances.capacity() * sizeof(instance) + bvh.memory_bytes();
+    }
+
+  private:
+    std::vector<instance> instances;
+    flat_bvh bvh;
+    aabb bbox;
+};
+
+#endif
@@ -3,56 +3,65 @@
 
 #include <limits>
 
-class interval{
+// A closed range of scalar type T; the renderer uses interval = interval_t<real>.
+template <typename T>
+class interval_t{
   public :
-    double min, max;
-    interval(): min(-std::numeric_limits<double>::infinity()), max(+std::numeric_limits<double>::infinity()){};
-    interval(double min, double max) : min(min), max(max) {}
-    interval(const interval&a, const interval&b){
+    using scalar = T;
+    T min, max;
+    interval_t(): min(-std::numeric_limits<T>::infinity()), max(+std::numeric_limits<T>::infinity()){};
+    interval_t(T min, T max) : min(min), max(max) {}
+    interval_t(const interval_t&a, const interval_t&b){
         // Create the interval tightly enclosing the two input intervals.
         min = a.min <= b.min ? a.min : b.min;
         max = a.max >= b.max ? a.max : b.max;
     }
-    
-    double size() const{
+
+    T size() const{
         return max - min;
     }
 
-    bool contains(double x ) const{
+    bool contains(T x ) const{
         return min <= x && x <= max ;
     }
 
-    bool surround (double x) const {
+    bool surround (T x) const {
         return min < x && x < max ;
     }
 
-    double clamp(double x)const{
+    T clamp(T x)const{
         if (x < min ) return min;
         if (x > max ) return max;
-        return x; 
+        return x;
     }
 
-    interval expand(double delta) const{
+    interval_t expand(T delta) const{
         auto padding = delta / 2;
-        return interval (min - padding , max + padding);
+        return interval_t (min - padding , max + padding);
     }
-    
-    
-    static const interval empty, universe;
 
 
-    ~interval() = default;
-    
+    static const interval_t empty, universe;
+
+
+    ~interval_t() = default;
+
 };
 
-const interval interval::empty = interval(+std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity());
-const interval interval::universe = interval(-std::numeric_limits<double>::infinity(), +std::numeric_limits<double>::infinity());
+template <typename T>
+const interval_t<T> interval_t<T>::empty = interval_t<T>(+std::numeric_limits<T>::infinity(), -std::numeric_limits<T>::infinity());
+template <typename T>
+const interval_t<T> interval_t<T>::universe = interval_t<T>(-std::numeric_limits<T>::infinity(), +std::numeric_limits<T>::infinity());
+
+using interval = interval_t<real>;
 
-interval operator+(const interval& ival, double displacement) {
-    return interval(ival.min + displacement, ival.max + displacement);
+template <typename T>
+interval_t<T> operator+(const interval_t<T>& ival, typename interval_t<T>::scalar displacement) {
+    return interval_t<T>(ival.min + displacement, ival.max + displacement);
 }
 
-interval operator+(double displacement, const interval& ival) {
+template <typename T>
+interval_t<T> operator+(typename interval_t<T>::scalar displacement, const interval_t<T>& ival) {
     return ival + displacement;
 }
-#endif
\ No newline at end of file
+#endif
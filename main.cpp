@@ -9,6 +9,13 @@
 #include "sphere.hpp"
 #include "constant_medium.hpp"
 #include "quad.hpp"
+#include "triangle_mesh.hpp"
+#include "mesh_loader.hpp"
+#include "instance.hpp"
+#include "sphere_set.hpp"
+#include "grid_medium.hpp"
+#include "perlin.hpp"
+#include "bench/scene_bench.hpp"
 
 #ifdef _WIN32
 
@@ -50,6 +57,7 @@ const bool thread_in_use =  true;
 
 
 void cornell_box2(){
+    trace_span build("scene build", "scene");
     hittable_list world;
     shared_ptr<material> red = make_shared<lambertian>(color(.65, .05, .05));
     shared_ptr<material> white = make_shared<lambertian>(color(.73, .73, .73));
@@ -85,6 +93,8 @@ void cornell_box2(){
         make_shared<quad>(point3(343,554,332), vec3(-130,0,0), vec3(0,0,-105), empty_material));
     lights.add(make_shared<sphere>(point3(190, 90, 190), 90, empty_material));
 
+    build.end();
+
     camera cam;
 
     cam.aspect_ratio      = 1.0;
@@ -110,7 +120,7 @@ void cornell_box2(){
 
 
 // void final_scene(int image_width, int samples_per_pixel, int max_depth) {
-//     hittable_list boxes1;
+//     auto boxes1 = make_shared<quad_set>();
 //     auto ground = make_shared<lambertian>(color(0.48, 0.83, 0.53));
 
 //     int boxes_per_side = 20;
@@ -124,13 +134,14 @@ void cornell_box2(){
 //             auto y1 = random_double(1,101);
 //             auto z1 = z0 + w;
 
-//             boxes1.add(box(point3(x0,y0,z0), point3(x1,y1,z1), ground));
+//             box(point3(x0,y0,z0), point3(x1,y1,z1), ground, *boxes1);
 //         }
 //     }
 
 //     hittable_list world;
 
-//     world.add(make_shared<bvh_node>(boxes1));
+//     boxes1->build();
+//     world.add(boxes1);
 
 //     auto light = make_shared<diffuse_light>(color(7, 7, 7));
 //     world.add(make_shared<quad>(point3(123,554,147), vec3(300,0,0), vec3(0,0,265), light));
@@ -165,7 +176,7 @@ void cornell_box2(){
 
 //     world.add(make_shared<translate>(
 //         make_shared<rotate_y>(
-//             make_shared<bvh_node>(boxes2), 15),
+//             make_shared<sphere_set>(boxes2), 15),
 //             vec3(-100,270,395)
 //         )
 //     );
@@ -191,56 +202,63 @@ void cornell_box2(){
 //         cam.render(world);
 // }
 
-// void cornell_smoke(){
+void cornell_smoke(){
 
-//     hittable_list world;
-//     auto red   = make_shared<lambertian>(color(.65, .05, .05));
-//     auto white = make_shared<lambertian>(color(.73, .73, .73));
-//     auto green = make_shared<lambertian>(color(.12, .45, .15));
-//     auto light = make_shared<diffuse_light>(color(7, 7, 7));
+    trace_span build("scene build", "scene");
+    hittable_list world;
+    auto red   = make_shared<lambertian>(color(.65, .05, .05));
+    auto white = make_shared<lambertian>(color(.73, .73, .73));
+    auto green = make_shared<lambertian>(color(.12, .45, .15));
+    auto light = make_shared<diffuse_light>(color(7, 7, 7));
 
-//     world.add(make_shared<quad>(point3(555,0,0), vec3(0,555,0), vec3(0,0,555), green));
-//     world.add(make_shared<quad>(point3(0,0,0), vec3(0,555,0), vec3(0,0,555), red));
-//     world.add(make_shared<quad>(point3(113,554,127), vec3(330,0,0), vec3(0,0,305), light));
-//     world.add(make_shared<quad>(point3(0,555,0), vec3(555,0,0), vec3(0,0,555), white));
-//     world.add(make_shared<quad>(point3(0,0,0), vec3(555,0,0), vec3(0,0,555), white));
-//     world.add(make_shared<quad>(point3(0,0,555), vec3(555,0,0), vec3(0,555,0), white));
+    world.add(make_shared<quad>(point3(555,0,0), vec3(0,555,0), vec3(0,0,555), green));
+    world.add(make_shared<quad>(point3(0,0,0), vec3(0,555,0), vec3(0,0,555), red));
+    world.add(make_shared<quad>(point3(113,554,127), vec3(330,0,0), vec3(0,0,305), light));
+    world.add(make_shared<quad>(point3(0,555,0), vec3(555,0,0), vec3(0,0,555), white));
+    world.add(make_shared<quad>(point3(0,0,0), vec3(555,0,0), vec3(0,0,555), white));
+    world.add(make_shared<quad>(point3(0,0,555), vec3(555,0,0), vec3(0,555,0), white));
 
-//     shared_ptr<hittable> box1 = box(point3(0,0,0), point3(165,330,165), white);
-//     box1 = make_shared<rotate_y>(box1, 15);
-//     box1 = make_shared<translate>(box1, vec3(265,0,295));
+    shared_ptr<hittable> box1 = box(point3(0,0,0), point3(165,330,165), white);
+    box1 = make_shared<rotate_y>(box1, 15);
+    box1 = make_shared<translate>(box1, vec3(265,0,295));
 
-//     shared_ptr<hittable> box2 = box(point3(0,0,0), point3(165,165,165), white);
-//     box2 = make_shared<rotate_y>(box2, -18);
-//     box2 = make_shared<translate>(box2, vec3(130,0,65));
+    shared_ptr<hittable> box2 = box(point3(0,0,0), point3(165,165,165), white);
+    box2 = make_shared<rotate_y>(box2, -18);
+    box2 = make_shared<translate>(box2, vec3(130,0,65));
 
-//     world.add(make_shared<constant_medium>(box1, 0.01, color(0,0,0)));
-//     world.add(make_shared<constant_medium>(box2, 0.01, color(1,1,1)));
+    world.add(make_shared<constant_medium>(box1, 0.01, color(0,0,0)));
+    world.add(make_shared<constant_medium>(box2, 0.01, color(1,1,1)));
 
-//     camera cam;
+    // Light Sources
+    auto empty_material = shared_ptr<material>();
+    quad lights(point3(113,554,127), vec3(330,0,0), vec3(0,0,305), empty_material);
 
-//     cam.aspect_ratio      = 1.0;
-//     cam.image_width       = 600;
-//     cam.samples_per_pixel = 200;
-//     cam.max_depth         = 50;
-//     cam.background        = color(0,0,0);
+    build.end();
 
-//     cam.vfov     = 40;
-//     cam.lookfrom = point3(278, 278, -800);
-//     cam.lookat   = point3(278, 278, 0);
-//     cam.vup      = vec3(0,1,0);
+    camera cam;
 
-//     cam.defocus_angle = 0;
+    cam.aspect_ratio      = 1.0;
+    cam.image_width       = 600;
+    cam.samples_per_pixel = 200;
+    cam.max_depth         = 50;
+    cam.background        = color(0,0,0);
 
-    
-//     if (thread_in_use){
-//         cam.render_multi_threads(world);
-//     }else
-//         cam.render(world);
+    cam.vfov     = 40;
+    cam.lookfrom = point3(278, 278, -800);
+    cam.lookat   = point3(278, 278, 0);
+    cam.vup      = vec3(0,1,0);
 
-// }
+    cam.defocus_angle = 0;
+
+    if (thread_in_use){
+        cam.render_multi_threads(world, lights);
+    }else
+        cam.render(world, lights);
+
+}
 
 void cornell_box(){
+    trace_span build("scene build", "scene");
     hittable_list world;
     shared_ptr<material> red = make_shared<lambertian>(color(.65, .05, .05));
     shared_ptr<material> white = make_shared<lambertian>(color(.73, .73, .73));
@@ -275,6 +293,8 @@ void cornell_box(){
     auto empty_material = shared_ptr<material>();
     quad lights(point3(343,554,332), vec3(-130,0,0), vec3(0,0,-105), empty_material);
 
+    build.end();
+
     camera cam;
 
     cam.aspect_ratio      = 1.0;
@@ -366,33 +386,43 @@ void cornell_box(){
     
 // }
 
-// void perlin_spheres() {
-//     hittable_list world;
+void perlin_spheres() {
+    // Both spheres wear one marble texture. Its turbulence is baked over the small sphere's box,
+    // where most of the noise is seen up close; the ground outside the box stays procedural.
+    trace_span build("scene build", "scene");
+    hittable_list world;
 
-//     auto pertext = make_shared<noise_texture>(4);
-//     world.add(make_shared<sphere>(point3(0,-1000,0), 1000, make_shared<lambertian>(pertext)));
-//     world.add(make_shared<sphere>(point3(0,2,0), 2, make_shared<lambertian>(pertext)));
+    auto pertext = make_shared<noise_texture>(4);
+    pertext->bake(aabb(point3(-2,0,-2), point3(2,4,2)), 96);
+    world.add(make_shared<sphere>(point3(0,-1000,0), 1000, make_shared<lambertian>(pertext)));
+    world.add(make_shared<sphere>(point3(0,2,0), 2, make_shared<lambertian>(pertext)));
 
-//     camera cam;
+    // The sky is the only light; see mesh_viewer().
+    hittable_list lights;
+    lights.add(make_shared<sphere>(point3(0, 10000, 0), 100, shared_ptr<material>()));
 
-//     cam.aspect_ratio      = 16.0 / 9.0;
-//     cam.image_width       = 400;
-//     cam.samples_per_pixel = 100;
-//     cam.max_depth         = 50;
-//     cam.background        = color(0.70, 0.80, 1.00);
-//     cam.vfov     = 20;
-//     cam.lookfrom = point3(13,2,3);
-//     cam.lookat   = point3(0,0,0);
-//     cam.vup      = vec3(0,1,0);
+    build.end();
 
-//     cam.defocus_angle = 0;
+    camera cam;
 
-//      if (thread_in_use){
-//         cam.render_multi_threads(world);
-//     }else
-//         cam.render(world);
-    
-// }
+    cam.aspect_ratio      = 16.0 / 9.0;
+    cam.image_width       = 400;
+    cam.samples_per_pixel = 100;
+    cam.max_depth         = 50;
+    cam.background        = color(0.70, 0.80, 1.00);
+
+    cam.vfov     = 20;
+    cam.lookfrom = point3(13,2,3);
+    cam.lookat   = point3(0,0,0);
+    cam.vup      = vec3(0,1,0);
+
+    cam.defocus_angle = 0;
+
+    if (thread_in_use){
+        cam.render_multi_threads(world, lights);
+    }else
+        cam.render(world, lights);
+}
 
 // void earth(){
 //     auto earth_texture = make_shared<image_texture>("./textures/earthmap.jpg");
@@ -527,8 +557,285 @@ void cornell_box(){
 
 // }
 
+void mesh_viewer(const char* filename){
+    // Renders a single OBJ or PLY mesh under a sky, with the camera framed on its bounding box.
+    trace_span build("scene build", "scene");
+    auto mesh = mesh_loader::load(filename);
+    if (mesh->triangle_count() == 0)
+        return;
+
+    hittable_list world;
+    auto surface = make_shared<triangle_mesh>(mesh, make_shared<lambertian>(color(.73, .73, .73)));
+    std::clog << "mesh memory: " << surface->memory_bytes() / (1024.0 * 1024.0) << " MiB ("
+              << double(surface->memory_bytes()) / surface->triangle_count() << " bytes/triangle)\n";
+    world.add(surface);
+
+    auto bbox = surface->bounding_box();
+    auto center = point3((bbox.x.min + bbox.x.max) / 2,
+                         (bbox.y.min + bbox.y.max) / 2,
+                         (bbox.z.min + bbox.z.max) / 2);
+    auto radius = 0.5 * vec3(bbox.x.size(), bbox.y.size(), bbox.z.size()).length();
+
+    // The sky is the only light. The light pdf still needs a shape to sample, so give it a
+    // sphere high above the mesh, which steers half of the bounce rays towards the sky.
+    hittable_list lights;
+    lights.add(make_shared<sphere>(center + vec3(0, 100 * radius, 0), radius, shared_ptr<material>()));
+
+    build.end();
+
+    camera cam;
+
+    cam.aspect_ratio      = 16.0 / 9.0;
+    cam.image_width       = 400;
+    cam.samples_per_pixel = 64;
+    cam.max_depth         = 20;
+    cam.background        = color(0.70, 0.80, 1.00);
+
+    cam.vfov     = 30;
+    cam.lookat   = center;
+    cam.lookfrom = center + radius * vec3(1.2, 1.0, 3.0);
+    cam.vup      = vec3(0,1,0);
+
+    cam.defocus_angle = 0;
+
+    if (thread_in_use){
+        cam.render_multi_threads(world, lights);
+    }else
+        cam.render(world, lights);
+}
+
+shared_ptr<mesh_data> tree_mesh(int segments){
+    // A low-poly tree: an open cone for the crown on a short open cylinder for the trunk.
+    auto mesh = make_shared<mesh_data>();
+
+    auto ring = [&](double y, double radius) {
+        uint32_t first = uint32_t(mesh->vertex_count());
+        for (int i = 0; i < segments; i++) {
+            auto phi = 2*pi*i / segments;
+            mesh->add_vertex(point3(radius*std::cos(phi), y, radius*std::sin(phi)));
+        }
+        return first;
+    };
+
+    uint32_t trunk_bottom = ring(0.0, 0.08);
+    uint32_t trunk_top    = ring(0.3, 0.08);
+    uint32_t crown_base   = ring(0.3, 0.5);
+    uint32_t crown_tip    = mesh->add_vertex(point3(0, 1.5, 0));
+
+    for (uint32_t i = 0; i < uint32_t(segments); i++) {
+        uint32_t j = (i + 1) % segments;
+        mesh->add_triangle(trunk_bottom + i, trunk_top + i, trunk_bottom + j);
+        mesh->add_triangle(trunk_bottom + j, trunk_top + i, trunk_top + j);
+        mesh->add_triangle(crown_base + i, crown_tip, crown_base + j);
+    }
+    return mesh;
+}
+
+void forest(){
+    // 10,000 instances of one tree mesh. The mesh and its BVH exist once; every instance is just a
+    // transform in the top-level instance_bvh.
+    trace_span build("scene build", "scene");
+    hittable_list world;
+
+    auto ground = make_shared<lambertian>(color(0.48, 0.83, 0.53));
+    world.add(make_shared<quad>(point3(-200, 0, -200), vec3(400, 0, 0), vec3(0, 0, 400), ground));
+
+    auto tree = make_shared<triangle_mesh>(tree_mesh(32), make_shared<lambertian>(color(0.1, 0.4, 0.1)));
+
+    int trees_per_side = 100;
+    std::vector<instance> trees;
+    trees.reserve(trees_per_side * trees_per_side);
+    for (int i = 0; i < trees_per_side; i++) {
+        for (int j = 0; j < trees_per_side; j++) {
+            auto position = vec3(-100 + 2.0*i + random_double(-0.5, 0.5), 0,
+                                 -100 + 2.0*j + random_double(-0.5, 0.5));
+            auto size = random_double(0.7, 1.3);
+            auto object_to_world = affine::translation(position)
+                                 * affine::rotation(vec3(0,1,0), random_double(0, 360))
+                                 * affine::scaling(vec3(size, size * random_double(0.8, 1.5), size));
+            trees.emplace_back(tree, object_to_world);
+        }
+    }
+    auto forest = make_shared<instance_bvh>(std::move(trees));
+    std::clog << "forest: " << forest->instance_count() << " instances of a "
+              << tree->triangle_count() << "-triangle mesh, top level "
+              << forest->memory_bytes() / 1024.0 << " KiB, shared mesh "
+              << tree->memory_bytes() / 1024.0 << " KiB\n";
+    world.add(forest);
+
+    // The sky is the only light; see mesh_viewer().
+    hittable_list lights;
+    lights.add(make_shared<sphere>(point3(0, 10000, 0), 100, shared_ptr<material>()));
+
+    build.end();
+
+    camera cam;
+
+    cam.aspect_ratio      = 16.0 / 9.0;
+    cam.image_width       = 400;
+    cam.samples_per_pixel = 64;
+    cam.max_depth         = 20;
+    cam.background        = color(0.70, 0.80, 1.00);
+
+    cam.vfov     = 40;
+    cam.lookfrom = point3(-110, 12, -110);
+    cam.lookat   = point3(0, 0, 0);
+    cam.vup      = vec3(0,1,0);
+
+    cam.defocus_angle = 0;
+
+    if (thread_in_use){
+        cam.render_multi_threads(world, lights);
+    }else
+        cam.render(world, lights);
+}
+
+void sphere_cloud(){
+    // 200,000 small spheres in a ball above the ground, all in one sphere_set.
+    trace_span build("scene build", "scene");
+    hittable_list world;
+
+    auto ground = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    world.add(make_shared<quad>(point3(-100, 0, -100), vec3(200, 0, 0), vec3(0, 0, 200), ground));
+
+    std::vector<shared_ptr<material>> palette;
+    for (int i = 0; i < 8; i++)
+        palette.push_back(make_shared<lambertian>(color::random() * color::random()));
+    palette.push_back(make_shared<metal>(color(0.8, 0.8, 0.9), 0.1));
+
+    hittable_list particles;
+    int particle_count = 200000;
+    while (int(particles.objects.size()) < particle_count) {
+        auto p = vec3::random(-1, 1);
+        if (p.length_squared() > 1)
+            continue;
+        auto mat = palette[int(random_double(0, double(palette.size())))];
+        particles.add(make_shared<sphere>(point3(0, 5, 0) + 4 * p, random_double(0.02, 0.06), mat));
+    }
+    auto cloud = make_shared<sphere_set>(particles);
+    std::clog << "sphere_cloud: " << cloud->sphere_count() << " spheres, "
+              << floatv::width << " per SIMD test, "
+              << cloud->memory_bytes() / double(cloud->sphere_count()) << " bytes per sphere\n";
+    world.add(cloud);
+
+    // The sky is the only light; see mesh_viewer().
+    hittable_list lights;
+    lights.add(make_shared<sphere>(point3(0, 10000, 0), 100, shared_ptr<material>()));
+
+    build.end();
+
+    camera cam;
+
+    cam.aspect_ratio      = 16.0 / 9.0;
+    cam.image_width       = 400;
+    cam.samples_per_pixel = 64;
+    cam.max_depth         = 20;
+    cam.background        = color(0.70, 0.80, 1.00);
+
+    cam.vfov     = 40;
+    cam.lookfrom = point3(0, 8, 18);
+    cam.lookat   = point3(0, 4, 0);
+    cam.vup      = vec3(0,1,0);
+
+    cam.defocus_angle = 0;
+
+    if (thread_in_use){
+        cam.render_multi_threads(world, lights);
+    }else
+        cam.render(world, lights);
+}
+
+void cloud(){
+    // A cumulus-like cloud in a 128 x 64 x 128 density grid: an ellipsoid roughened by Perlin
+    // turbulence. Most of the grid's bricks are empty and neither stored nor visited.
+    trace_span build("scene build", "scene");
+    hittable_list world;
+
+    auto ground = make_shared<lambertian>(color(0.45, 0.5, 0.4));
+    world.add(make_shared<quad>(point3(-100, 0, -100), vec3(200, 0, 0), vec3(0, 0, 200), ground));
+
+    const int nx = 128, ny = 64, nz = 128;
+    const aabb bounds(point3(-8, 1, -8), point3(8, 9, 8));
+    const point3 center(0, 4.5, 0);
+    const vec3 radii(6.5, 3, 6.5);
+    perlin noise;
+    std::vector<float> density(size_t(nx) * ny * nz);
+    for (int z = 0; z < nz; z++)
+        for (int y = 0; y < ny; y++)
+            for (int x = 0; x < nx; x++) {
+                point3 p(-8 + 16 * (x + 0.5) / nx, 1 + 8 * (y + 0.5) / ny, -8 + 16 * (z + 0.5) / nz);
+                vec3 q = (p - center) * vec3(1 / radii.x(), 1 / radii.y(), 1 / radii.z());
+                double shape = 1 - q.length() + 0.7 * (noise.turb(0.6 * p, 5) - 0.35);
+                density[(size_t(z) * ny + y) * nx + x] = float(std::fmax(0.0, std::fmin(1.0, 2 * shape)));
+            }
+
+    auto medium = make_shared<grid_medium>(bounds, density_grid(nx, ny, nz, density), 3.0,
+                                           color(0.95, 0.95, 0.95));
+    const density_grid& grid = medium->density();
+    std::clog << "cloud: " << grid.stored_bricks() << " of "
+              << grid.bricks_x() * grid.bricks_y() * grid.bricks_z() << " bricks stored, "
+              << medium->memory_bytes() / 1024.0 << " KiB\n";
+    world.add(medium);
+
+    // The sky is the only light; see mesh_viewer().
+    hittable_list lights;
+    lights.add(make_shared<sphere>(point3(0, 10000, 0), 100, shared_ptr<material>()));
+
+    build.end();
+
+    camera cam;
+
+    cam.aspect_ratio      = 16.0 / 9.0;
+    cam.image_width       = 400;
+    cam.samples_per_pixel = 64;
+    cam.max_depth         = 20;
+    cam.background        = color(0.70, 0.80, 1.00);
+
+    cam.vfov     = 40;
+    cam.lookfrom = point3(0, 5, 19);
+    cam.lookat   = point3(0, 4.5, 0);
+    cam.vup      = vec3(0,1,0);
+
+    cam.defocus_angle = 0;
+
+    if (thread_in_use){
+        cam.render_multi_threads(world, lights);
+    }else
+        cam.render(world, lights);
+}
+
+bool run_scene(int case_number, const char* arg){
+    // Builds and renders scene case_number; false if there is no such scene.
+    switch(case_number){
+        // case 1 : bouncing_spheres(); break;
+        // case 2 : checkered_spheres(); break;
+        // case 3 : earth(); break;
+        case 4 : perlin_spheres() ; break;
+        // case 5 : quads() ; break;
+        // case 6 : simple_light() ; break;
+        case 7 : cornell_box() ; break;
+        case 8 : cornell_smoke() ; break;
+        // case 9:  final_scene(800, 10000, 40); break;
+        case 10 : cornell_box2() ; break;
+        case 11 : mesh_viewer(arg) ; break;
+        case 12 : forest() ; break;
+        case 13 : sphere_cloud() ; break;
+        case 14 : cloud() ; break;
+        default : return false;
+    }
+    return true;
+}
+
 int main(int argc, char** argv){
 
+    if (const char* trace_path = std::getenv("RT_TRACE"))
+        trace_log::start(trace_path);
+
+    if (argc >= 2 && std::string(argv[1]) == "bench") {
+        scene_bench bench([](int case_number) { return run_scene(case_number, ""); });
+        return bench.parse(argc - 2, argv + 2) ? bench.run() : 1;
+    }
+
     int case_number = 7;
     if (argc >= 2) 
         case_number = std::atoi(argv[1]);//// 將 argv[1] 轉成整數
@@ -543,7 +850,14 @@ int main(int argc, char** argv){
                 << "  7: cornell_box\n"
                 << "  8: cornell_smoke\n"
                 << "  9: final_scene\n" 
-                << "  10: cornell_box2\n" << std::flush;
+                << "  10: cornell_box2\n"
+                << "  11: mesh_viewer <file.obj|file.ply>\n"
+                << "  12: forest\n"
+                << "  13: sphere_cloud\n"
+                << "  14: cloud\n"
+                << "  --wavefront after the scene number: use the wavefront integrator\n"
+                << "  --sort-rays: the same, with each wave sorted by ray origin and direction\n"
+                << "  bench [options]: time the scenes, see bench/scene_bench.hpp\n" << std::flush;
     
  
     #ifdef _WIN32
@@ -552,23 +866,22 @@ int main(int argc, char** argv){
     
     auto t_start = std::chrono::high_resolution_clock::now();
     
-    switch(case_number){
-        // case 1 : bouncing_spheres(); break;
-        // case 2 : checkered_spheres(); break;
-        // case 3 : earth(); break;
-        // case 4 : perlin_spheres() ; break;
-        // case 5 : quads() ; break;
-        // case 6 : simple_light() ; break;
-        case 7 : cornell_box() ; break;
-        // case 8:  cornell_smoke(); break;
-        // case 9:  final_scene(800, 10000, 40); break;
-        case 10 : cornell_box2() ; break;
+    // Options after the scene number; anything else is the scene's own argument.
+    const char* scene_arg = "";
+    for (int k = 2; k < argc; k++) {
+        std::string option = argv[k];
+        if (option == "--wavefront")
+            camera::overrides().wavefront = true;
+        else if (option == "--sort-rays")
+            camera::overrides().sort_rays = true;
+        else
+            scene_arg = argv[k];
+    }
 
-        default:
-            std::clog << "Unknown scene " << case_number << ", defaulting final scene.\n";
-            // final_scene(400,   250,  4);
-            cornell_box2();
-            break;
+    if (!run_scene(case_number, scene_arg)) {
+        std::clog << "Unknown scene " << case_number << ", defaulting final scene.\n";
+        // final_scene(400,   250,  4);
+        cornell_box2();
     }
 
      //record excution time 
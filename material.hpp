@@ -6,6 +6,14 @@
 #include "texture.hpp"
 #include "pdf.hpp"
 
+// Looks tex up at the hit, computing the hit's UVs only if the texture reads them.
+inline color texture_value(const texture_ref& tex, const hit_record& rec) {
+    real u = 0, v = 0;
+    if (tex.uses_uv())
+        rec.surface_uv(u, v);
+    return tex.value(u, v, rec.p);
+}
+
 class scatter_record {
   public:
     color attenuation;
@@ -14,8 +22,13 @@ class scatter_record {
     ray skip_pdf_ray;
 };
 
+// Tag for the built-in materials, used by the inline dispatch at the end of this file. User
+// materials keep the default `custom` tag and are reached through the virtual interface.
+enum class material_kind { custom, lambertian, metal, dielectric, diffuse_light, isotropic };
+
 class  material{
   public:
+    material() : kind(material_kind::custom) {}
     virtual ~material() = default;
     virtual color emitted(
       const ray& r_in, const hit_record& rec, double u, double v, const point3& p
@@ -31,19 +44,34 @@ class  material{
     const{
       return 0;  
     }
+
+    const material_kind kind;
+
+  private:
+    // The inline dispatch casts a material to the class its kind names, so only those classes
+    // may claim a built-in kind: the tagged constructor and its key are private to them.
+    friend class lambertian;
+    friend class metal;
+    friend class dielectric;
+    friend class diffuse_light;
+    friend class isotropic;
+
+    struct builtin_key {};
+
+    material(material_kind kind, builtin_key) : kind(kind) {}
 };
 
 
-class lambertian : public material{
+class lambertian final : public material{
   public :
 
-    // 1. 傳入color -> 呼叫 texture建構子
-    lambertian(const color& albedo) : tex(make_shared<solid_color>(albedo)){}
+    // 1. 傳入color -> 直接存成 inline 的 texture_ref
+    lambertian(const color& albedo) : material(material_kind::lambertian, builtin_key()), tex(albedo){}
     // 2. 傳入 texture 
-    lambertian(shared_ptr<texture> tex) : tex(tex){};
+    lambertian(shared_ptr<texture> tex) : material(material_kind::lambertian, builtin_key()), tex(tex){};
 
     bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const override {
-        srec.attenuation = tex->value(rec.u, rec.v, rec.p);
+        srec.attenuation = texture_value(tex, rec);
         srec.pdf_ptr = make_shared<cosine_pdf>(rec.normal);
         srec.skip_pdf = false;
         return true;
@@ -58,13 +86,13 @@ class lambertian : public material{
 
 
   private :
-    color albedo;
-    shared_ptr<texture> tex;
+    texture_ref tex;
 };
 
-class metal : public material{
+class metal final : public material{
   public : 
-    metal(const color& albedo, double fuzz) : albedo(albedo), fuzz(fuzz){};
+    metal(const color& albedo, double fuzz)
+      : material(material_kind::metal, builtin_key()), albedo(albedo), fuzz(fuzz){};
     
     bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec)
     const override {
@@ -86,9 +114,10 @@ class metal : public material{
 
 };
 
-class dielectric : public material {
+class dielectric final : public material {
   public :
-    dielectric(double refraction_index) : refraction_index(refraction_index) {}
+    dielectric(double refraction_index)
+      : material(material_kind::dielectric, builtin_key()), refraction_index(refraction_index) {}
 
     bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) 
     const override {
@@ -106,7 +135,7 @@ class dielectric : public material {
         bool cannot_refract = ri * sin_theta > 1.0;
         vec3 direction;
 
-        if (cannot_refract || reflectance(cos_theta, ri) > random_double())
+        if (cannot_refract || reflectance(cos_theta, ri) > sample_1d())
             direction = reflect(unit_direction, rec.normal);
         else
             direction = refract(unit_direction, rec.normal, ri);
@@ -123,33 +152,40 @@ class dielectric : public material {
         // Use Schlick's approximation for reflectance.
         auto r0 = (1 - refraction_index) / (1 + refraction_index);
         r0 = r0*r0;
-        return r0 + (1-r0)*std::pow((1 - cosine),5);
+        return r0 + (1-r0)*pow5(1 - cosine);
     }
 };
 
-class diffuse_light :public material{
+class diffuse_light final :public material{
   public :
-    diffuse_light(shared_ptr<texture> tex) : tex(tex){};
-    diffuse_light(const color& emit) :tex(make_shared<solid_color>(emit)) {};
+    diffuse_light(shared_ptr<texture> tex) : material(material_kind::diffuse_light, builtin_key()), tex(tex){};
+    diffuse_light(const color& emit) : material(material_kind::diffuse_light, builtin_key()), tex(emit) {};
     
     color emitted(const ray& r_in, const hit_record& rec, double u, double v, const point3& p)
     const override {
         if (!rec.front_face)
             return color(0,0,0);
-        return tex->value(u, v, p);
+        return tex.value(u, v, p);
+    }
+
+    color emitted(const ray& r_in, const hit_record& rec) const {
+        // As above, with the UVs computed only if the texture reads them.
+        if (!rec.front_face)
+            return color(0,0,0);
+        return texture_value(tex, rec);
     }
   private :
-    shared_ptr<texture> tex ;
+    texture_ref tex ;
 
 };
 
-class isotropic : public material {
+class isotropic final : public material {
   public:
-    isotropic(const color& albedo) : tex(make_shared<solid_color>(albedo)) {}
-    isotropic(shared_ptr<texture> tex) : tex(tex) {}
+    isotropic(const color& albedo) : material(material_kind::isotropic, builtin_key()), tex(albedo) {}
+    isotropic(shared_ptr<texture> tex) : material(material_kind::isotropic, builtin_key()), tex(tex) {}
 
     bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const override {
-        srec.attenuation = tex->value(rec.u, rec.v, rec.p);
+        srec.attenuation = texture_value(tex, rec);
         srec.pdf_ptr = make_shared<sphere_pdf>();
         srec.skip_pdf = false;
         return true;
@@ -161,6 +197,55 @@ class isotropic : public material {
     }
 
   private:
-    shared_ptr<texture> tex;
+    texture_ref tex;
 };
+
+// Inline dispatch over the closed set of built-in materials. The classes above are final, so each
+// static_cast call below binds directly to the override and can be inlined; only `custom`
+// materials pay for a virtual call.
+inline color emitted(const material& mat, const ray& r_in, const hit_record& rec) {
+    switch (mat.kind) {
+        case material_kind::diffuse_light:
+            return static_cast<const diffuse_light&>(mat).emitted(r_in, rec);
+        case material_kind::custom: {
+            real u, v;
+            rec.surface_uv(u, v);
+            return mat.emitted(r_in, rec, u, v, rec.p);
+        }
+        default:
+            return color(0, 0, 0);
+    }
+}
+
+inline bool scatter(const material& mat, const ray& r_in, const hit_record& rec,
+                    scatter_record& srec) {
+    switch (mat.kind) {
+        case material_kind::lambertian:
+            return static_cast<const lambertian&>(mat).scatter(r_in, rec, srec);
+        case material_kind::metal:
+            return static_cast<const metal&>(mat).scatter(r_in, rec, srec);
+        case material_kind::dielectric:
+            return static_cast<const dielectric&>(mat).scatter(r_in, rec, srec);
+        case material_kind::isotropic:
+            return static_cast<const isotropic&>(mat).scatter(r_in, rec, srec);
+        case material_kind::diffuse_light:
+            return false;
+        default:
+            return mat.scatter(r_in, rec, srec);
+    }
+}
+
+inline double scattering_pdf(const material& mat, const ray& r_in, const hit_record& rec,
+                             const ray& scattered) {
+    switch (mat.kind) {
+        case material_kind::lambertian:
+            return static_cast<const lambertian&>(mat).scattering_pdf(r_in, rec, scattered);
+        case material_kind::isotropic:
+            return static_cast<const isotropic&>(mat).scattering_pdf(r_in, rec, scattered);
+        case material_kind::custom:
+            return mat.scattering_pdf(r_in, rec, scattered);
+        default:
+            return 0;
+    }
+}
 #endif
\ No newline at end of file
@@ -0,0 +1,746 @@
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
+#include "triangle_mesh.hpp"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file. If the file could not be opened or mapped, is_open()
+// returns false and data() is null.
+class mapped_file {
+  public:
+    mapped_file(const std::string& filename) {
+      #ifdef _WIN32
+        file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                           OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return;
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) return;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr) return;
+        ptr = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (ptr) length = size_t(file_size.QuadPart);
+      #else
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                ptr = static_cast<const char*>(p);
+                length = size_t(st.st_size);
+                madvise(p, length, MADV_SEQUENTIAL);
+            }
+        }
+        close(fd);
+      #endif
+    }
+
+    ~mapped_file() {
+      #ifdef _WIN32
+        if (ptr) UnmapViewOfFile(ptr);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+      #else
+        if (ptr) munmap(const_cast<char*>(ptr), length);
+      #endif
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    bool is_open() const { return ptr != nullptr; }
+    const char* data() const { return ptr; }
+    size_t size() const { return length; }
+
+  private:
+    const char* ptr = nullptr;
+    size_t length = 0;
+  #ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+  #endif
+};
+
+// Loaders for Wavefront OBJ and binary PLY meshes. Both map the file into memory and parse it
+// straight into the structure-of-arrays mesh_data used by triangle_mesh, splitting the work into
+// one chunk per hardware thread. Polygons with more than three corners are triangulated as fans.
+// On failure an error is printed and an empty mesh is returned.
+class mesh_loader {
+  public:
+    static shared_ptr<mesh_data> load(const std::string& filename) {
+        auto dot = filename.find_last_of('.');
+        auto ext = (dot == std::string::npos) ? std::string() : filename.substr(dot + 1);
+        for (auto& c : ext) c = char(std::tolower(static_cast<unsigned char>(c)));
+
+        if (ext == "ply") return load_ply(filename);
+        return load_obj(filename);
+    }
+
+    static shared_ptr<mesh_data> load_obj(const std::string& filename) {
+        auto t_start = std::chrono::high_resolution_clock::now();
+        auto mesh = make_shared<mesh_data>();
+
+        mapped_file file(filename);
+        if (!file.is_open()) {
+            std::cerr << "ERROR: Could not open mesh file '" << filename << "'.\n";
+            return mesh;
+        }
+
+        const char* begin = file.data();
+        const char* end = begin + file.size();
+        auto bounds = split_lines(begin, end, thread_count());
+        size_t n_chunks = bounds.size() - 1;
+
+        // Pass 1: count vertex attributes per chunk, so that every chunk knows how many came
+        // before it and can resolve OBJ's relative (negative) indices on its own.
+        std::vector<obj_chunk> chunks(n_chunks);
+        parallel_for(n_chunks, [&](size_t c) {
+            count_obj_attributes(bounds[c], bounds[c + 1], chunks[c]);
+        });
+        for (size_t c = 1; c < n_chunks; c++) {
+            chunks[c].v_base  = chunks[c-1].v_base  + chunks[c-1].v_count;
+            chunks[c].vt_base = chunks[c-1].vt_base + chunks[c-1].vt_count;
+            chunks[c].vn_base = chunks[c-1].vn_base + chunks[c-1].vn_count;
+        }
+
+        // Pass 2: parse every chunk into chunk-local arrays.
+        parallel_for(n_chunks, [&](size_t c) { parse_obj_chunk(bounds[c], bounds[c + 1], chunks[c]); });
+
+        if (!merge_obj_chunks(chunks, *mesh)) {
+            std::cerr << "ERROR: Mesh file '" << filename << "' has out-of-range face indices.\n";
+            return make_shared<mesh_data>();
+        }
+
+        report(filename, file.size(), *mesh, t_start);
+        return mesh;
+    }
+
+    static shared_ptr<mesh_data> load_ply(const std::string& filename) {
+        auto t_start = std::chrono::high_resolution_clock::now();
+        auto mesh = make_shared<mesh_data>();
+
+        mapped_file file(filename);
+        if (!file.is_open()) {
+            std::cerr << "ERROR: Could not open mesh file '" << filename << "'.\n";
+            return mesh;
+        }
+
+        ply_header header;
+        if (!parse_ply_header(file.data(), file.data() + file.size(), header)) {
+            std::cerr << "ERROR: '" << filename << "' is not a supported binary PLY file.\n";
+            return mesh;
+        }
+
+        if (!parse_ply_body(file.data() + header.body_offset, file.data() + file.size(),
+                            header, *mesh)) {
+            std::cerr << "ERROR: Could not read the body of PLY file '" << filename << "'.\n";
+            return make_shared<mesh_data>();
+        }
+
+        report(filename, file.size(), *mesh, t_start);
+        return mesh;
+    }
+
+  private:
+    static unsigned thread_count() {
+        unsigned n = std::thread::hardware_concurrency();
+        return n == 0 ? 4 : n;
+    }
+
+    template <typename Fn>
+    static void parallel_for(size_t count, const Fn& fn) {
+        // Calls fn(i) for every i in [0, count), one thread per index.
+        if (count == 1) {
+            fn(0);
+            return;
+        }
+        std::vector<std::thread> threads;
+        threads.reserve(count);
+        for (size_t i = 0; i < count; i++)
+            threads.emplace_back([&fn, i]() { fn(i); });
+        for (auto& th : threads) th.join();
+    }
+
+    static void report(const std::string& filename, size_t bytes, const mesh_data& mesh,
+                       std::chrono::high_resolution_clock::time_point t_start) {
+        auto t_end = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration<double>(t_end - t_start).count();
+        double mb = bytes / (1024.0 * 1024.0);
+        std::clog << "Loaded '" << filename << "': " << mesh.vertex_count() << " vertices, "
+                  << mesh.triangle_count() << " triangles, " << mb << " MiB in " << seconds
+                  << " seconds (" << mb / seconds << " MiB/s, "
+                  << mesh.triangle_count() / seconds / 1e6 << " Mtri/s)\n";
+    }
+
+    // Text parsing helpers shared by the OBJ and PLY header parsers.
+
+    static std::vector<const char*> split_lines(const char* begin, const char* end, size_t n) {
+        // Returns n+1 chunk boundaries (fewer for small inputs), each one at the start of a line.
+        std::vector<const char*> bounds{begin};
+        size_t size = size_t(end - begin);
+        for (size_t i = 1; i < n; i++) {
+            const char* p = begin + size * i / n;
+            if (p <= bounds.back()) continue;
+            p = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)));
+            if (p == nullptr) break;
+            if (p + 1 > bounds.back() && p + 1 < end) bounds.push_back(p + 1);
+        }
+        bounds.push_back(end);
+        return bounds;
+    }
+
+    static bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    static const char* skip_space(const char* p, const char* end) {
+        while (p < end && is_space(*p)) p++;
+        return p;
+    }
+
+    static const char* next_line(const char* p, const char* end) {
+        p = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)));
+        return p ? p + 1 : end;
+    }
+
+    static bool parse_int(const char*& p, const char* end, long& value) {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+        if (p >= end || *p < '0' || *p > '9') return false;
+        long v = 0;
+        while (p < end && *p >= '0' && *p <= '9') v = v*10 + (*p++ - '0');
+        value = negative ? -v : v;
+        return true;
+    }
+
+    static bool parse_float(const char*& p, const char* end, float& value) {
+        // A small decimal parser: [sign] digits [. digits] [(e|E) [sign] digits]. It avoids the
+        // locale handling of strtof, which dominates the load time of large OBJ files.
+        p = skip_space(p, end);
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+
+        double mantissa = 0;
+        bool any_digit = false;
+        while (p < end && *p >= '0' && *p <= '9') {
+            mantissa = mantissa*10 + (*p++ - '0');
+            any_digit = true;
+        }
+        if (p < end && *p == '.') {
+            p++;
+            double scale = 0.1;
+            while (p < end && *p >= '0' && *p <= '9') {
+                mantissa += (*p++ - '0') * scale;
+                scale *= 0.1;
+                any_digit = true;
+            }
+        }
+        if (!any_digit) return false;
+
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            p++;
+            long exponent;
+            if (!parse_int(p, end, exponent)) return false;
+            mantissa *= std::pow(10.0, double(exponent));
+        }
+        value = float(negative ? -mantissa : mantissa);
+        return true;
+    }
+
+    // OBJ
+
+    struct obj_chunk {
+        size_t v_count = 0, vt_count = 0, vn_count = 0;     // Attributes in this chunk
+        size_t v_base = 0, vt_base = 0, vn_base = 0;        // Attributes in earlier chunks
+
+        std::vector<float> px, py, pz, nx, ny, nz, tu, tv;
+        std::vector<uint32_t> face_v, face_vt, face_vn;     // Three entries per triangle
+        bool has_vt = false, has_vn = false;
+        bool shared_indices = true;     // Every corner uses the same index for v, vt and vn
+    };
+
+    static void count_obj_attributes(const char* p, const char* end, obj_chunk& chunk) {
+        while (p < end) {
+            p = skip_space(p, end);
+            if (p + 1 < end && p[0] == 'v') {
+                if (is_space(p[1]))  chunk.v_count++;
+                else if (p[1] == 't') chunk.vt_count++;
+                else if (p[1] == 'n') chunk.vn_count++;
+            }
+            p = next_line(p, end);
+        }
+    }
+
+    static void parse_obj_chunk(const char* p, const char* end, obj_chunk& chunk) {
+        chunk.px.reserve(chunk.v_count);
+        chunk.py.reserve(chunk.v_count);
+        chunk.pz.reserve(chunk.v_count);
+
+        const uint32_t missing = UINT32_MAX;
+        std::vector<uint32_t> corner_v, corner_vt, corner_vn;
+
+        while (p < end) {
+            p = skip_space(p, end);
+            const char* line_end = next_line(p, end);
+
+            if (p + 1 < line_end && p[0] == 'v' && is_space(p[1])) {
+                float x = 0, y = 0, z = 0;
+                p += 1;
+                parse_float(p, line_end, x);
+                parse_float(p, line_end, y);
+                parse_float(p, line_end, z);
+                chunk.px.push_back(x);
+                chunk.py.push_back(y);
+                chunk.pz.push_back(z);
+            } else if (p + 2 < line_end && p[0] == 'v' && p[1] == 'n' && is_space(p[2])) {
+                float x = 0, y = 0, z = 0;
+                p += 2;
+                parse_float(p, line_end, x);
+                parse_float(p, line_end, y);
+                parse_float(p, line_end, z);
+                chunk.nx.push_back(x);
+                chunk.ny.push_back(y);
+                chunk.nz.push_back(z);
+            } else if (p + 2 < line_end && p[0] == 'v' && p[1] == 't' && is_space(p[2])) {
+                float u = 0, v = 0;
+                p += 2;
+                parse_float(p, line_end, u);
+                parse_float(p, line_end, v);
+                chunk.tu.push_back(u);
+                chunk.tv.push_back(v);
+            } else if (p + 1 < line_end && p[0] == 'f' && is_space(p[1])) {
+                // Corners are v, v/vt, v//vn or v/vt/vn; negative indices count back from the
+                // most recently declared attribute, and 0 is invalid.
+                corner_v.clear();
+                corner_vt.clear();
+                corner_vn.clear();
+                p += 1;
+
+                auto resolve = [](long index, size_t base, size_t local) -> uint32_t {
+                    if (index == 0)
+                        return UINT32_MAX - 1;
+                    long absolute = index > 0 ? index - 1 : long(base + local) + index;
+                    return absolute < 0 ? UINT32_MAX - 1 : uint32_t(absolute);
+                };
+
+                while (true) {
+                    p = skip_space(p, line_end);
+                    long iv, it = 0, in = 0;
+                    if (!parse_int(p, line_end, iv)) break;
+                    bool has_t = false, has_n = false;
+                    if (p < line_end && *p == '/') {
+                        p++;
+                        has_t = parse_int(p, line_end, it);
+                        if (p < line_end && *p == '/') {
+                            p++;
+                            has_n = parse_int(p, line_end, in);
+                        }
+                    }
+                    while (p < line_end && !is_space(*p) && *p != '\n') p++;
+
+                    uint32_t v  = resolve(iv, chunk.v_base, chunk.px.size());
+                    uint32_t vt = has_t ? resolve(it, chunk.vt_base, chunk.tu.size()) : missing;
+                    uint32_t vn = has_n ? resolve(in, chunk.vn_base, chunk.nx.size()) : missing;
+                    chunk.has_vt |= has_t;
+                    chunk.has_vn |= has_n;
+                    if ((has_t && vt != v) || (has_n && vn != v))
+                        chunk.shared_indices = false;
+
+                    corner_v.push_back(v);
+                    corner_vt.push_back(vt);
+                    corner_vn.push_back(vn);
+                }
+
+                for (size_t k = 2; k < corner_v.size(); k++) {
+                    size_t fan[3] = { 0, k - 1, k };
+                    for (size_t c : fan) {
+                        chunk.face_v.push_back(corner_v[c]);
+                        chunk.face_vt.push_back(corner_vt[c]);
+                        chunk.face_vn.push_back(corner_vn[c]);
+                    }
+                }
+            }
+
+            p = line_end;
+        }
+    }
+
+    static bool merge_obj_chunks(std::vector<obj_chunk>& chunks, mesh_data& mesh) {
+        size_t v_total = 0, vt_total = 0, vn_total = 0, corner_total = 0;
+        bool has_vt = false, has_vn = false, shared_indices = true;
+        for (const auto& chunk : chunks) {
+            v_total += chunk.px.size();
+            vt_total += chunk.tu.size();
+            vn_total += chunk.nx.size();
+            corner_total += chunk.face_v.size();
+            has_vt |= chunk.has_vt;
+            has_vn |= chunk.has_vn;
+            shared_indices &= chunk.shared_indices;
+        }
+
+        auto append = [](std::vector<float>& dst, const std::vector<float>& src) {
+            dst.insert(dst.end(), src.begin(), src.end());
+        };
+
+        if (shared_indices && (!has_vt || vt_total == v_total) && (!has_vn || vn_total == v_total)) {
+            // Fast path: positions, normals and UVs are already indexed together, so the chunk
+            // arrays can be concatenated as they are.
+            mesh.px.reserve(v_total);
+            mesh.py.reserve(v_total);
+            mesh.pz.reserve(v_total);
+            mesh.indices.reserve(corner_total);
+            for (const auto& chunk : chunks) {
+                append(mesh.px, chunk.px);
+                append(mesh.py, chunk.py);
+                append(mesh.pz, chunk.pz);
+                if (has_vn) {
+                    append(mesh.nx, chunk.nx);
+                    append(mesh.ny, chunk.ny);
+                    append(mesh.nz, chunk.nz);
+                }
+                if (has_vt) {
+                    append(mesh.tu, chunk.tu);
+                    append(mesh.tv, chunk.tv);
+                }
+                mesh.indices.insert(mesh.indices.end(), chunk.face_v.begin(), chunk.face_v.end());
+            }
+            for (auto index : mesh.indices)
+                if (index >= v_total) return false;
+            return true;
+        }
+
+        // General path: corners reference positions, normals and UVs independently, so build one
+        // output vertex per distinct (v, vt, vn) combination.
+        std::vector<float> px, py, pz, nx, ny, nz, tu, tv;
+        for (const auto& chunk : chunks) {
+            append(px, chunk.px); append(py, chunk.py); append(pz, chunk.pz);
+            append(nx, chunk.nx); append(ny, chunk.ny); append(nz, chunk.nz);
+            append(tu, chunk.tu); append(tv, chunk.tv);
+        }
+
+        struct key_hash {
+            size_t operator()(const std::array<uint32_t, 3>& k) const {
+                return (size_t(k[0]) * 73856093u) ^ (size_t(k[1]) * 19349663u)
+                     ^ (size_t(k[2]) * 83492791u);
+            }
+        };
+        std::unordered_map<std::array<uint32_t, 3>, uint32_t, key_hash> remap;
+        remap.reserve(v_total);
+        mesh.indices.reserve(corner_total);
+
+        for (auto& chunk : chunks) {
+            for (size_t i = 0; i < chunk.face_v.size(); i++) {
+                std::array<uint32_t, 3> key{ chunk.face_v[i], chunk.face_vt[i], chunk.face_vn[i] };
+                if (key[0] >= v_total) return false;
+                auto found = remap.find(key);
+                if (found != remap.end()) {
+                    mesh.indices.push_back(found->second);
+                    continue;
+                }
+
+                uint32_t index = mesh.add_vertex(point3(px[key[0]], py[key[0]], pz[key[0]]));
+                if (has_vn) {
+                    bool ok = key[2] < nx.size();
+                    mesh.nx.push_back(ok ? nx[key[2]] : 0);
+                    mesh.ny.push_back(ok ? ny[key[2]] : 0);
+                    mesh.nz.push_back(ok ? nz[key[2]] : 0);
+                }
+                if (has_vt) {
+                    bool ok = key[1] < tu.size();
+                    mesh.tu.push_back(ok ? tu[key[1]] : 0);
+                    mesh.tv.push_back(ok ? tv[key[1]] : 0);
+                }
+                remap.emplace(key, index);
+                mesh.indices.push_back(index);
+            }
+            chunk = obj_chunk();    // Release the chunk's memory as we go.
+        }
+        return true;
+    }
+
+    // PLY
+
+    enum class ply_type { none, i8, u8, i16, u16, i32, u32, f32, f64 };
+
+    struct ply_property {
+        std::string name;
+        ply_type type = ply_type::none;
+        ply_type list_count_type = ply_type::none;     // Set for list properties only
+        size_t offset = 0;                              // Byte offset within a fixed-size element
+    };
+
+    struct ply_element {
+        std::string name;
+        size_t count = 0;
+        std::vector<ply_property> properties;
+        size_t stride = 0;      // Byte size of one element, or 0 if it contains lists
+    };
+
+    struct ply_header {
+        bool big_endian = false;
+        std::vector<ply_element> elements;
+        size_t body_offset = 0;
+    };
+
+    static size_t ply_type_size(ply_type t) {
+        switch (t) {
+            case ply_type::i8:  case ply_type::u8:  return 1;
+            case ply_type::i16: case ply_type::u16: return 2;
+            case ply_type::i32: case ply_type::u32: case ply_type::f32: return 4;
+            case ply_type::f64: return 8;
+            default: return 0;
+        }
+    }
+
+    static ply_type ply_type_from_name(const std::string& name) {
+        if (name == "char"   || name == "int8")    return ply_type::i8;
+        if (name == "uchar"  || name == "uint8")   return ply_type::u8;
+        if (name == "short"  || name == "int16")   return ply_type::i16;
+        if (name == "ushort" || name == "uint16")  return ply_type::u16;
+        if (name == "int"    || name == "int32")   return ply_type::i32;
+        if (name == "uint"   || name == "uint32")  return ply_type::u32;
+        if (name == "float"  || name == "float32") return ply_type::f32;
+        if (name == "double" || name == "float64") return ply_type::f64;
+        return ply_type::none;
+    }
+
+    static double read_ply_value(const char* p, ply_type t, bool big_endian) {
+        unsigned char bytes[8];
+        size_t n = ply_type_size(t);
+        std::memcpy(bytes, p, n);
+        if (big_endian) std::reverse(bytes, bytes + n);
+
+        switch (t) {
+            case ply_type::i8:  { int8_t v;   std::memcpy(&v, bytes, 1); return v; }
+            case ply_type::u8:  { uint8_t v;  std::memcpy(&v, bytes, 1); return v; }
+            case ply_type::i16: { int16_t v;  std::memcpy(&v, bytes, 2); return v; }
+            case ply_type::u16: { uint16_t v; std::memcpy(&v, bytes, 2); return v; }
+            case ply_type::i32: { int32_t v;  std::memcpy(&v, bytes, 4); return v; }
+            case ply_type::u32: { uint32_t v; std::memcpy(&v, bytes, 4); return v; }
+            case ply_type::f32: { float v;    std::memcpy(&v, bytes, 4); return v; }
+            case ply_type::f64: { double v;   std::memcpy(&v, bytes, 8); return v; }
+            default: return 0;
+        }
+    }
+
+    static bool parse_ply_header(const char* begin, const char* end, ply_header& header) {
+        const char* p = begin;
+        auto read_word = [&](const char* line_end) {
+            p = skip_space(p, line_end);
+            const char* start = p;
+            while (p < line_end && !is_space(*p) && *p != '\n') p++;
+            return std::string(start, p);
+        };
+
+        const char* line_end = next_line(p, end);
+        if (read_word(line_end) != "ply") return false;
+        p = line_end;
+
+        bool format_ok = false;
+        while (p < end) {
+            line_end = next_line(p, end);
+            std::string keyword = read_word(line_end);
+
+            if (keyword == "format") {
+                std::string format = read_word(line_end);
+                header.big_endian = (format == "binary_big_endian");
+                format_ok = header.big_endian || format == "binary_little_endian";
+            } else if (keyword == "element") {
+                ply_element element;
+                element.name = read_word(line_end);
+                element.count = size_t(std::strtoull(read_word(line_end).c_str(), nullptr, 10));
+                header.elements.push_back(element);
+            } else if (keyword == "property") {
+                if (header.elements.empty()) return false;
+                ply_property property;
+                std::string type = read_word(line_end);
+                if (type == "list") {
+                    property.list_count_type = ply_type_from_name(read_word(line_end));
+                    property.type = ply_type_from_name(read_word(line_end));
+                    if (property.list_count_type == ply_type::none) return false;
+                } else {
+                    property.type = ply_type_from_name(type);
+                }
+                if (property.type == ply_type::none) return false;
+                property.name = read_word(line_end);
+                header.elements.back().properties.push_back(property);
+            } else if (keyword == "end_header") {
+                header.body_offset = size_t(line_end - begin);
+                break;
+            }
+            p = line_end;
+        }
+
+        for (auto& element : header.elements) {
+            size_t offset = 0;
+            bool fixed = true;
+            for (auto& property : element.properties) {
+                property.offset = offset;
+                if (property.list_count_type != ply_type::none) fixed = false;
+                offset += ply_type_size(property.type);
+            }
+            element.stride = fixed ? offset : 0;
+        }
+
+        return format_ok && header.body_offset > 0;
+    }
+
+    static bool parse_ply_body(const char* p, const char* end, const ply_header& header,
+                               mesh_data& mesh) {
+        for (const auto& element : header.elements) {
+            if (element.name == "vertex") {
+                if (element.stride == 0) return false;
+                if (size_t(end - p) < element.count * element.stride) return false;
+                read_ply_vertices(p, element, header.big_endian, mesh);
+                p += element.count * element.stride;
+            } else if (element.name == "face") {
+                if (!read_ply_faces(p, end, element, header.big_endian, mesh)) return false;
+            } else {
+                // Skip any other element; we can only do that if its size is known up front.
+                if (element.stride == 0) return false;
+                p += element.count * element.stride;
+            }
+            if (p > end) return false;
+        }
+
+        for (auto index : mesh.indices)
+            if (index >= mesh.vertex_count()) return false;
+        return true;
+    }
+
+    static void read_ply_vertices(const char* p, const ply_element& element, bool big_endian,
+                                  mesh_data& mesh) {
+        // Vertex records have a fixed stride, so each thread converts its own range in place.
+        const ply_property* channels[8] = {};
+        const char* names[8][3] = {
+            {"x"}, {"y"}, {"z"}, {"nx"}, {"ny"}, {"nz"},
+            {"u", "s", "texture_u"}, {"v", "t", "texture_v"}
+        };
+        for (const auto& property : element.properties)
+            for (int c = 0; c < 8; c++)
+                for (const char* name : names[c])
+                    if (name && property.name == name) channels[c] = &property;
+
+        std::vector<float>* arrays[8] = {
+            &mesh.px, &mesh.py, &mesh.pz, &mesh.nx, &mesh.ny, &mesh.nz, &mesh.tu, &mesh.tv
+        };
+        bool has_normals = channels[3] && channels[4] && channels[5];
+        bool has_uvs = channels[6] && channels[7];
+        for (int c = 0; c < 8; c++) {
+            bool wanted = c < 3 || (c < 6 ? has_normals : has_uvs);
+            if (wanted) arrays[c]->resize(element.count);
+            else channels[c] = nullptr;
+        }
+
+        size_t n_chunks = std::min<size_t>(thread_count(), std::max<size_t>(element.count / 65536, 1));
+        parallel_for(n_chunks, [&](size_t chunk) {
+            size_t first = element.count * chunk / n_chunks;
+            size_t last = element.count * (chunk + 1) / n_chunks;
+            for (int c = 0; c < 8; c++) {
+                if (!channels[c]) continue;
+                const ply_property& property = *channels[c];
+                float* out = arrays[c]->data();
+                if (property.type == ply_type::f32 && !big_endian) {
+                    for (size_t i = first; i < last; i++)
+                        std::memcpy(&out[i], p + i * element.stride + property.offset, 4);
+                } else {
+                    for (size_t i = first; i < last; i++)
+                        out[i] = float(read_ply_value(p + i * element.stride + property.offset,
+                                                      property.type, big_endian));
+                }
+            }
+        });
+    }
+
+    static bool read_ply_faces(const char*& p, const char* end, const ply_element& element,
+                               bool big_endian, mesh_data& mesh) {
+        // Only the vertex index list is used; any other face properties must come after it or
+        // be fixed-size so they can be skipped.
+        const ply_property* list = nullptr;
+        size_t before = 0, after = 0;
+        for (const auto& property : element.properties) {
+            bool is_index_list = property.list_count_type != ply_type::none
+                                 && (property.name == "vertex_indices"
+                                     || property.name == "vertex_index");
+            if (is_index_list && !list) {
+                list = &property;
+            } else if (property.list_count_type != ply_type::none) {
+                return false;
+            } else {
+                (list ? after : before) += ply_type_size(property.type);
+            }
+        }
+        if (!list) return false;
+
+        size_t count_size = ply_type_size(list->list_count_type);
+        size_t index_size = ply_type_size(list->type);
+        size_t triangle_stride = before + count_size + 3 * index_size + after;
+
+        // Most large meshes are pure triangles. If the remaining bytes fit that layout and the
+        // first face agrees, read the faces in parallel with a fixed stride.
+        bool all_triangles = size_t(end - p) >= element.count * triangle_stride
+                             && element.count > 0
+                             && read_ply_value(p + before, list->list_count_type, big_endian) == 3;
+        if (all_triangles) {
+            mesh.indices.resize(element.count * 3);
+            std::vector<char> bad(thread_count(), 0);
+            size_t n_chunks = std::min<size_t>(thread_count(), std::max<size_t>(element.count / 65536, 1));
+            parallel_for(n_chunks, [&](size_t chunk) {
+                size_t first = element.count * chunk / n_chunks;
+                size_t last = element.count * (chunk + 1) / n_chunks;
+                for (size_t f = first; f < last; f++) {
+                    const char* face = p + f * triangle_stride + before;
+                    if (read_ply_value(face, list->list_count_type, big_endian) != 3) {
+                        bad[chunk] = 1;
+                        return;
+                    }
+                    for (int k = 0; k < 3; k++)
+                        mesh.indices[f*3 + k] = uint32_t(read_ply_value(
+                            face + count_size + k * index_size, list->type, big_endian));
+                }
+            });
+            if (std::find(bad.begin(), bad.end(), 1) == bad.end()) {
+                p += element.count * triangle_stride;
+                return true;
+            }
+            mesh.indices.clear();
+        }
+
+        // Mixed polygons: walk the faces in order and fan-triangulate.
+        std::vector<uint32_t> corners;
+        for (size_t f = 0; f < element.count; f++) {
+            if (size_t(end - p) < before + count_size) return false;
+            p += before;
+            size_t n = size_t(read_ply_value(p, list->list_count_type, big_endian));
+            p += count_size;
+            if (size_t(end - p) < n * index_size + after) return false;
+
+            corners.clear();
+            for (size_t k = 0; k < n; k++, p += index_size)
+                corners.push_back(uint32_t(read_ply_value(p, list->type, big_endian)));
+            for (size_t k = 2; k < n; k++)
+                mesh.add_triangle(corners[0], corners[k-1], corners[k]);
+            p += after;
+        }
+        return true;
+    }
+};
+
+#endif
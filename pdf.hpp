@@ -71,7 +71,7 @@ class mixture_pdf : public pdf {
     }
 
     vec3 generate() const override {
-        if (random_double() < 0.5)
+        if (sample_1d() < 0.5)
             return p[0]->generate();
         else
             return p[1]->generate();
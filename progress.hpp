@@ -0,0 +1,120 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+// Progress of a render, shared by all its threads. The render threads add the camera samples and
+// rays they finish to two counters with relaxed atomic adds, tile by tile, and never wait on
+// anything. A reporter thread of its own wakes up a few times a second and shows the fraction
+// done, the ray throughput and the time left:
+//     Rendering  42.3%   11.85 Mrays/s   ETA 0:00:12
+// By default the line is redrawn in place on std::clog. For batch jobs, give a log path instead:
+// a line is appended there every few seconds and nothing is drawn on the terminal. The renderer
+// takes the path from camera::progress_log or the RT_PROGRESS_LOG environment variable.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class render_progress {
+  public:
+    // total_samples is the number of camera samples the render will take; an empty log_path
+    // reports on the terminal.
+    render_progress(uint64_t total_samples, const std::string& log_path = "")
+      : total_samples(total_samples), start(std::chrono::steady_clock::now())
+    {
+        if (!log_path.empty()) {
+            log.open(log_path, std::ios::app);
+            if (!log)
+                std::cerr << "ERROR: cannot open the progress log " << log_path
+                          << "; progress is not reported.\n";
+            quiet = true;
+        }
+        reporter = std::thread([this] { report_until_done(); });
+    }
+
+    ~render_progress() { finish(); }
+
+    render_progress(const render_progress&) = delete;
+    render_progress& operator=(const render_progress&) = delete;
+
+    // Called by the render threads as tiles are finished.
+    void add(uint64_t samples, uint64_t rays) {
+        samples_done.fetch_add(samples, std::memory_order_relaxed);
+        rays_done.fetch_add(rays, std::memory_order_relaxed);
+    }
+
+    // Stops the reporter after one last report. Call once the render threads have finished.
+    void finish() {
+        if (!reporter.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+        }
+        wake.notify_one();
+        reporter.join();
+    }
+
+  private:
+    const uint64_t total_samples;
+    const std::chrono::steady_clock::time_point start;
+    std::atomic<uint64_t> samples_done{0};
+    std::atomic<uint64_t> rays_done{0};
+    std::ofstream log;
+    bool quiet = false;             // Log lines to `log` rather than redrawing the terminal
+
+    std::thread reporter;
+    std::mutex mutex;               // Guards done, for the reporter's timed wait
+    std::condition_variable wake;
+    bool done = false;
+
+    void report_until_done() {
+        const auto interval = std::chrono::milliseconds(quiet ? 5000 : 250);
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!wake.wait_for(lock, interval, [this] { return done; }))
+            report(false);
+        report(true);
+    }
+
+    void report(bool last) {
+        double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        double fraction = total_samples ? double(samples_done.load(std::memory_order_relaxed))
+                                          / total_samples : 1.0;
+        double mrays = seconds > 0 ? rays_done.load(std::memory_order_relaxed) / seconds * 1e-6 : 0;
+
+        char line[96];
+        if (last) {
+            std::snprintf(line, sizeof(line), "Rendered  %5.1f%%  %9.2f Mrays/s   in %.2f s",
+                          100 * fraction, mrays, seconds);
+        } else {
+            std::string eta = fraction > 0 ? clock_time(seconds * (1 - fraction) / fraction)
+                                           : std::string("-:--:--");
+            std::snprintf(line, sizeof(line), "Rendering %5.1f%%  %9.2f Mrays/s   ETA %s",
+                          100 * fraction, mrays, eta.c_str());
+        }
+
+        if (quiet) {
+            if (log)
+                log << line << std::endl;
+        } else {
+            std::clog << '\r' << line << "  " << (last ? "\n" : "") << std::flush;
+        }
+    }
+
+    static std::string clock_time(double seconds) {
+        // h:mm:ss, rounded to the second.
+        long s = long(seconds + 0.5);
+        char text[32];
+        std::snprintf(text, sizeof(text), "%ld:%02ld:%02ld", s / 3600, s / 60 % 60, s % 60);
+        return text;
+    }
+};
+
+#endif
@@ -20,16 +20,36 @@ class quad : public hittable{
     }
 
     virtual void set_bounding_box(){
+        bbox = corners_box(Q, u, v);
+    }
+
+    static aabb corners_box(const point3& Q, const vec3& u, const vec3& v) {
         // compute the bounding box of all four vertices
         // for aabb searching 
         auto bbox_diagonal1 = aabb(Q, Q + u + v);
         auto bbox_diagonal2 = aabb(Q + u , Q  + v);
-        bbox = aabb(bbox_diagonal1, bbox_diagonal2);
+        return aabb(bbox_diagonal1, bbox_diagonal2);
     }
 
 
     aabb bounding_box() const override {return bbox;}
     bool hit (const ray&r, interval ray_t, hit_record& rec)const override{
+        return intersect_and_finish(r, ray_t, rec);
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (!exact_hit(Q, u, v, w, normal, D, r, ray_t, rec))
+            return false;
+        rec.pending = this;
+        return true;
+    }
+
+    // The exact test, on a quad's plane data alone, so that quad_set can run it without quad
+    // objects. On a hit, sets rec.t and the UVs.
+    static bool exact_hit(const point3& Q, const vec3& u, const vec3& v, const vec3& w,
+                          const vec3& normal, real D, const ray& r, interval ray_t,
+                          hit_record& rec) {
+        RT_COUNT_TEST(quad);
         auto denom = dot(normal, r.direction());
         // No hit if the ray is parallel to the plane.
         if (std::fabs(denom) < 1e-8)
@@ -53,37 +73,49 @@ class quad : public hittable{
             return false;
 
         rec.t = t ;
-        rec.p = intersection;
+        return true;
+    }
+
+    void finish_hit(const ray& r, hit_record& rec) const override {
+        // is_interior() has already set the UVs.
+        rec.p = r.at(rec.t);
         rec.mat = mat;
         rec.set_face_normal(r, normal);
-        return true;
     }
 
-    bool is_interior(double a, double b, hit_record& rec) const {
+    // Defined in quad_set.hpp, next to the float test it shares with quad_set.
+    uint64_t hit_packet(ray_packet& packet, uint64_t mask, hit_record* recs) const override;
+
+    static bool is_interior(double a, double b, hit_record& rec) {
         interval unit_interval = interval(0, 1);
         if (!unit_interval.contains(a) || !unit_interval.contains(b))
             return false;
 
         rec.u = a;
         rec.v = b;
+        rec.deferred_uv = nullptr;
         return true;
     }
     double pdf_value(const point3& origin, const vec3& direction) const override {
         hit_record rec;
-        if (!this->hit(ray(origin, direction), interval(0.001, infinity), rec))
+        ray r(origin, direction);
+        if (!this->intersect(r, r.hit_range(), rec))
             return 0;
 
         auto distance_squared = rec.t * rec.t * direction.length_squared();
-        auto cosine = std::fabs(dot(direction, rec.normal) / direction.length());
+        auto cosine = std::fabs(dot(direction, normal) / direction.length());
 
         return distance_squared / (cosine * area);
     }
 
     vec3 random(const point3& origin) const override {
-        auto p = Q + (random_double() * u) + (random_double() * v);
+        auto p = Q + (sample_1d() * u) + (sample_1d() * v);
         return p - origin;
     }
   private :
+    friend class quad_set;
+    friend struct quad_lanes;
+
     point3 Q; 
     vec3 u ;
     vec3 v;
@@ -91,33 +123,11 @@ class quad : public hittable{
     shared_ptr<material> mat;
     aabb bbox;
     vec3 normal;
-    double D;
-    double area;
+    real D;
+    real area;
 };
 
-inline shared_ptr<hittable_list> box(const point3& a, const point3& b, shared_ptr<material> mat)
-{
-    // Returns the 3D box (six sides) that contains the two opposite vertices a & b.
-
-    auto sides = make_shared<hittable_list>();
-
-    // Construct the two opposite vertices with the minimum and maximum coordinates.
-    auto min = point3(std::fmin(a.x(),b.x()), std::fmin(a.y(),b.y()), std::fmin(a.z(),b.z()));
-    auto max = point3(std::fmax(a.x(),b.x()), std::fmax(a.y(),b.y()), std::fmax(a.z(),b.z()));
-
-    auto dx = vec3(max.x() - min.x(), 0, 0);
-    auto dy = vec3(0, max.y() - min.y(), 0);
-    auto dz = vec3(0, 0, max.z() - min.z());
-
-    sides->add(make_shared<quad>(point3(min.x(), min.y(), max.z()),  dx,  dy, mat)); // front
-    sides->add(make_shared<quad>(point3(max.x(), min.y(), max.z()), -dz,  dy, mat)); // right
-    sides->add(make_shared<quad>(point3(max.x(), min.y(), min.z()), -dx,  dy, mat)); // back
-    sides->add(make_shared<quad>(point3(min.x(), min.y(), min.z()),  dz,  dy, mat)); // left
-    sides->add(make_shared<quad>(point3(min.x(), max.y(), max.z()),  dx, -dz, mat)); // top
-    sides->add(make_shared<quad>(point3(min.x(), min.y(), min.z()),  dx,  dz, mat)); // bottom
-
-    return sides;
-}
-
-#endif
+// box() lives in quad_set.hpp, which needs the complete quad class.
+#include "quad_set.hpp"
 
+#endif
\ No newline at end of file
@@ -0,0 +1,384 @@
+#ifndef QUAD_SET_H
+#define QUAD_SET_H
+
+#include "hittable.hpp"
+#include "hittable_list.hpp"
+#include "quad.hpp"
+#include "flat_bvh.hpp"
+#include "simd.hpp"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// The conservative float quad test, with each lane holding one quad and one ray. quad_set fills
+// the lanes with many quads and one ray, quad::hit_packet with one quad and many rays.
+//
+// With P the hit point, alpha = dot(P - Q, a) and beta = dot(P - Q, b), where a = cross(v, w) and
+// b = cross(w, u) fold quad::hit's two cross products into precomputed vectors.
+struct quad_lanes {
+    floatv qx, qy, qz;          // Corner Q
+    floatv nx, ny, nz, d;       // Plane: dot(n, P) = d
+    floatv ax, ay, az;          // Alpha axis
+    floatv bx, by, bz;          // Beta axis
+    floatv a_len, b_len;        // |a| and |b|, for the error bound
+    floatv extent;              // Largest corner coordinate, for the error bound
+
+    struct ray_lanes {
+        floatv ox, oy, oz, dx, dy, dz;
+        floatv length;          // |d|
+        floatv origin_size;     // max(|ox|, |oy|, |oz|), for the error bound
+        floatv t_min, t_max;
+
+        ray_lanes() {}
+
+        ray_lanes(const ray& r)
+          : ox(float(r.origin().x())), oy(float(r.origin().y())), oz(float(r.origin().z())),
+            dx(float(r.direction().x())), dy(float(r.direction().y())),
+            dz(float(r.direction().z())),
+            length(float(r.direction().length())),
+            origin_size(float(std::fmax(std::fabs(r.origin().x()),
+                              std::fmax(std::fabs(r.origin().y()), std::fabs(r.origin().z())))))
+        {}
+    };
+
+    quad_lanes() {}
+
+    quad_lanes(const quad& q) {
+        // Every lane holds the same quad.
+        vec3 a = cross(q.v, q.w);
+        vec3 b = cross(q.w, q.u);
+        qx = float(q.Q.x());  qy = float(q.Q.y());  qz = float(q.Q.z());
+        nx = float(q.normal.x());  ny = float(q.normal.y());  nz = float(q.normal.z());
+        d = float(q.D);
+        ax = float(a.x());  ay = float(a.y());  az = float(a.z());
+        bx = float(b.x());  by = float(b.y());  bz = float(b.z());
+        a_len = float(a.length());
+        b_len = float(b.length());
+        extent = float(extent_of(q.bbox));
+    }
+
+    static double extent_of(const aabb& box) {
+        double size = 0;
+        for (int k = 0; k < 3; k++)
+            size = std::fmax(size, std::fmax(std::fabs(box.axis_interval(k).min),
+                                             std::fabs(box.axis_interval(k).max)));
+        return size;
+    }
+
+    int candidates(const ray_lanes& r) const {
+        // A lane is set unless the float test shows, with room to spare, that quad::hit would
+        // miss.
+        floatv denom = nx*r.dx + ny*r.dy + nz*r.dz;
+        floatv abs_denom = abs(denom);
+
+        // Near-parallel rays lose too much precision in float; leave those lanes to quad::hit.
+        maskv grazing = abs_denom < floatv(1e-5f) * r.length;
+
+        floatv t = (d - (nx*r.ox + ny*r.oy + nz*r.oz)) / denom;
+        floatv abs_t = abs(t);
+        floatv size = r.origin_size + extent;
+
+        floatv t_tolerance = floatv(1e-5f) * (abs_t + size / abs_denom);
+        maskv in_range = (t >= r.t_min - t_tolerance) & (t <= r.t_max + t_tolerance);
+
+        floatv px = r.ox + t*r.dx - qx;
+        floatv py = r.oy + t*r.dy - qy;
+        floatv pz = r.oz + t*r.dz - qz;
+        floatv alpha = px*ax + py*ay + pz*az;
+        floatv beta  = px*bx + py*by + pz*bz;
+
+        // Bound on the error of the float hit point, including what an error in t moves it by.
+        floatv position_error = floatv(1e-5f)
+                              * (size + abs_t * r.length * (floatv(1.0f) + r.length / abs_denom));
+        floatv alpha_tolerance = floatv(1e-5f) + position_error * a_len;
+        floatv beta_tolerance  = floatv(1e-5f) + position_error * b_len;
+        maskv inside = (alpha >= floatv(0.0f) - alpha_tolerance)
+                     & (alpha <= floatv(1.0f) + alpha_tolerance)
+                     & (beta  >= floatv(0.0f) - beta_tolerance)
+                     & (beta  <= floatv(1.0f) + beta_tolerance);
+
+        return (grazing | (in_range & inside)).bits();
+    }
+};
+
+// Many quads as one hittable, for architectural scenes made of boxes. The plane and the two
+// in-plane coordinate vectors of every quad are stored as structure-of-arrays floats in BVH leaf
+// order, and each BVH leaf (up to floatv::width quads) is tested with one SIMD pass.
+//
+// As in sphere_set, the float pass is a conservative filter and its survivors are intersected
+// again by quad's exact test, on an exact copy of the plane data, so results are exactly those
+// of the separate quad objects. No quad objects are kept: add() the quads, e.g. with box(), then
+// build() the set once.
+class quad_set : public hittable {
+  public:
+    quad_set() {}
+
+    quad_set(const hittable_list& list) {
+        for (const auto& object : list.objects) {
+            auto q = std::dynamic_pointer_cast<quad>(object);
+            if (!q) {
+                std::cerr << "ERROR: quad_set only holds quads; skipping another object.\n";
+                continue;
+            }
+            add(q->Q, q->u, q->v, q->mat);
+        }
+        build();
+    }
+
+    // Adds the quad with corner Q and sides u and v, as quad's constructor takes them.
+    void add(const point3& Q, const vec3& u, const vec3& v, shared_ptr<material> mat) {
+        auto found = material_ids.emplace(mat.get(), uint32_t(materials.size()));
+        if (found.second)
+            materials.push_back(mat);
+
+        exact_quad q;
+        q.Q = Q;
+        q.u = u;
+        q.v = v;
+        auto n = cross(u, v);
+        q.normal = unit_vector(n);
+        q.D = dot(q.normal, Q);
+        q.w = n / dot(n,n);
+        q.mat = found.first->second;
+        exact.push_back(q);
+    }
+
+    // For quads that are exactly the six sides of `solid`, as box() makes: the set is then a
+    // closed convex object and its convex_span() is a slab test against `solid`.
+    void set_solid(const aabb& solid) {
+        solid_box = solid;
+        is_box = true;
+    }
+
+    void build() {
+        // Every quad is in, so the material lookup is no longer needed.
+        std::unordered_map<const material*, uint32_t>().swap(material_ids);
+
+        size_t n = exact.size();
+        std::vector<flat_bvh::bounds3> bounds;
+        bounds.reserve(n);
+        for (const auto& q : exact)
+            bounds.emplace_back(quad::corners_box(q.Q, q.u, q.v));
+
+        bvh = flat_bvh(bounds, floatv::width);
+        bbox = bvh.bounding_box();
+
+        // Put every leaf's quads next to each other, then fill the SIMD arrays in that order.
+        std::vector<exact_quad> sorted;
+        sorted.reserve(n);
+        for (uint32_t id : bvh.primitive_order())
+            sorted.push_back(exact[id]);
+        exact.swap(sorted);
+        exact.shrink_to_fit();
+
+        for (auto* v : soa_arrays())
+            v->assign(n + floatv::width, 0.0f);
+
+        for (size_t i = 0; i < n; i++) {
+            const exact_quad& q = exact[i];
+            vec3 a = cross(q.v, q.w);
+            vec3 b = cross(q.w, q.u);
+
+            qx[i] = float(q.Q.x());  qy[i] = float(q.Q.y());  qz[i] = float(q.Q.z());
+            nx[i] = float(q.normal.x());  ny[i] = float(q.normal.y());  nz[i] = float(q.normal.z());
+            d[i] = float(q.D);
+            ax[i] = float(a.x());  ay[i] = float(a.y());  az[i] = float(a.z());
+            bx[i] = float(b.x());  by[i] = float(b.y());  bz[i] = float(b.z());
+            a_len[i] = float(a.length());
+            b_len[i] = float(b.length());
+
+            extent[i] = float(quad_lanes::extent_of(quad::corners_box(q.Q, q.u, q.v)));
+        }
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return intersect_and_finish(r, ray_t, rec);
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        // Leaves the record pending on the quad that was hit, with its UVs already set.
+        quad_lanes::ray_lanes rl(r);
+
+        return bvh.traverse_leaves(r, ray_t,
+            [&](uint32_t first, uint32_t count, interval& t_range) {
+                int candidates = candidate_mask(rl, first, t_range) & ((1 << count) - 1);
+                bool hit_leaf = false;
+                while (candidates) {
+                    int lane = 0;
+                    while (!((candidates >> lane) & 1)) lane++;
+                    candidates &= candidates - 1;
+
+                    const exact_quad& q = exact[first + lane];
+                    if (quad::exact_hit(q.Q, q.u, q.v, q.w, q.normal, q.D, r, t_range, rec)) {
+                        t_range.max = rec.t;
+                        rec.pending = this;
+                        rec.prim = first + lane;
+                        hit_leaf = true;
+                    }
+                }
+                return hit_leaf;
+            });
+    }
+
+    void finish_hit(const ray& r, hit_record& rec) const override {
+        const exact_quad& q = exact[rec.prim];
+        rec.p = r.at(rec.t);
+        rec.mat = materials[q.mat];
+        rec.set_face_normal(r, q.normal);
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    bool is_convex() const override { return is_box; }
+
+    bool convex_span(const ray& r, interval& inside) const override {
+        if (!is_box)
+            return false;
+        inside = interval::universe;
+        for (int axis = 0; axis < 3; axis++) {
+            const interval& ax = solid_box.axis_interval(axis);
+            if (r.direction()[axis] == 0) {
+                // Parallel to this slab: inside it everywhere or nowhere. Dividing would give
+                // 0 * inf = NaN for an origin on a slab plane.
+                if (r.origin()[axis] < ax.min || r.origin()[axis] > ax.max)
+                    return false;
+                continue;
+            }
+            real adinv = real(1.0) / r.direction()[axis];
+            real t0 = (ax.min - r.origin()[axis]) * adinv;
+            real t1 = (ax.max - r.origin()[axis]) * adinv;
+            if (t0 > t1) std::swap(t0, t1);
+            if (t0 > inside.min) inside.min = t0;
+            if (t1 < inside.max) inside.max = t1;
+        }
+        return inside.min < inside.max;
+    }
+
+    size_t quad_count() const { return exact.size(); }
+
+    size_t memory_bytes() const {
+        return soa_array_count * qx.capacity() * sizeof(float)
+             + exact.capacity() * sizeof(exact_quad)
+             + materials.capacity() * sizeof(shared_ptr<material>) + bvh.memory_bytes();
+    }
+
+  private:
+    // The plane data quad's exact test needs, and the quad's material.
+    struct exact_quad {
+        point3 Q;
+        vec3 u, v, w;
+        vec3 normal;
+        real D;
+        uint32_t mat;                   // Index into materials
+    };
+
+    // SIMD copy, in leaf order and padded by one vector so a leaf load never runs off the end.
+    // See quad_lanes for what the arrays hold.
+    std::vector<float> qx, qy, qz;      // Corner Q
+    std::vector<float> nx, ny, nz, d;   // Plane: dot(n, P) = d
+    std::vector<float> ax, ay, az;      // Alpha axis
+    std::vector<float> bx, by, bz;      // Beta axis
+    std::vector<float> a_len, b_len;    // |a| and |b|, for the error bound
+    std::vector<float> extent;          // Largest corner coordinate, for the error bound
+
+    std::vector<exact_quad> exact;      // Exact copy, in the same order
+    std::vector<shared_ptr<material>> materials;
+    std::unordered_map<const material*, uint32_t> material_ids;    // Into materials; add() only
+    flat_bvh bvh;
+    aabb bbox;
+    aabb solid_box;                     // The box the quads enclose, if is_box
+    bool is_box = false;
+
+    static const int soa_array_count = 16;
+
+    std::vector<std::vector<float>*> soa_arrays() {
+        return { &qx, &qy, &qz, &nx, &ny, &nz, &d, &ax, &ay, &az, &bx, &by, &bz,
+                 &a_len, &b_len, &extent };
+    }
+
+    int candidate_mask(quad_lanes::ray_lanes& rl, uint32_t first, const interval& ray_t) const {
+        // One SIMD pass over the quads first, first + 1, ... of a leaf.
+        rl.t_min = floatv(float(ray_t.min));
+        rl.t_max = floatv(float(ray_t.max));
+
+        quad_lanes q;
+        q.qx = floatv::load(&qx[first]);  q.qy = floatv::load(&qy[first]);  q.qz = floatv::load(&qz[first]);
+        q.nx = floatv::load(&nx[first]);  q.ny = floatv::load(&ny[first]);  q.nz = floatv::load(&nz[first]);
+        q.d  = floatv::load(&d[first]);
+        q.ax = floatv::load(&ax[first]);  q.ay = floatv::load(&ay[first]);  q.az = floatv::load(&az[first]);
+        q.bx = floatv::load(&bx[first]);  q.by = floatv::load(&by[first]);  q.bz = floatv::load(&bz[first]);
+        q.a_len = floatv::load(&a_len[first]);
+        q.b_len = floatv::load(&b_len[first]);
+        q.extent = floatv::load(&extent[first]);
+
+        return q.candidates(rl);
+    }
+};
+
+inline uint64_t quad::hit_packet(ray_packet& packet, uint64_t mask, hit_record* recs) const {
+    // The float test of quad_lanes on floatv::width rays at a time, then quad::hit on the rays
+    // that pass it.
+    const quad_lanes q(*this);
+    const uint64_t lane_bits = (uint64_t(1) << floatv::width) - 1;
+    uint64_t hits = 0;
+
+    for (int base = 0; base < packet.size; base += floatv::width) {
+        uint64_t lanes = (mask >> base) & lane_bits;
+        if (!lanes)
+            continue;
+
+        quad_lanes::ray_lanes r;
+        r.ox = floatv::load(packet.ox + base);
+        r.oy = floatv::load(packet.oy + base);
+        r.oz = floatv::load(packet.oz + base);
+        r.dx = floatv::load(packet.dx + base);
+        r.dy = floatv::load(packet.dy + base);
+        r.dz = floatv::load(packet.dz + base);
+        r.length = sqrt(r.dx*r.dx + r.dy*r.dy + r.dz*r.dz);
+        r.origin_size = max(abs(r.ox), max(abs(r.oy), abs(r.oz)));
+        r.t_min = floatv::load(packet.t_min_f + base);
+        r.t_max = floatv::load(packet.t_max_f + base);
+
+        for (uint64_t m = lanes & uint64_t(q.candidates(r)); m; m &= m - 1) {
+            int i = base + ray_packet::lowest(m);
+            if (quad::hit(packet.rays[i], interval(packet.t_min[i], packet.t_max[i]), recs[i])) {
+                packet.set_t_max(i, recs[i].t);
+                hits |= uint64_t(1) << i;
+            }
+        }
+    }
+    return hits;
+}
+
+inline void box(const point3& a, const point3& b, shared_ptr<material> mat, quad_set& sides)
+{
+    // Adds the six sides of the 3D box that contains the two opposite vertices a & b to `sides`,
+    // so that many boxes can share one quad_set. build() the set once every box is in.
+
+    // Construct the two opposite vertices with the minimum and maximum coordinates.
+    auto min = point3(std::fmin(a.x(),b.x()), std::fmin(a.y(),b.y()), std::fmin(a.z(),b.z()));
+    auto max = point3(std::fmax(a.x(),b.x()), std::fmax(a.y(),b.y()), std::fmax(a.z(),b.z()));
+
+    auto dx = vec3(max.x() - min.x(), 0, 0);
+    auto dy = vec3(0, max.y() - min.y(), 0);
+    auto dz = vec3(0, 0, max.z() - min.z());
+
+    sides.add(point3(min.x(), min.y(), max.z()),  dx,  dy, mat); // front
+    sides.add(point3(max.x(), min.y(), max.z()), -dz,  dy, mat); // right
+    sides.add(point3(max.x(), min.y(), min.z()), -dx,  dy, mat); // back
+    sides.add(point3(min.x(), min.y(), min.z()),  dz,  dy, mat); // left
+    sides.add(point3(min.x(), max.y(), max.z()),  dx, -dz, mat); // top
+    sides.add(point3(min.x(), min.y(), min.z()),  dx,  dz, mat); // bottom
+}
+
+inline shared_ptr<quad_set> box(const point3& a, const point3& b, shared_ptr<material> mat)
+{
+    // Returns the 3D box (six sides) that contains the two opposite vertices a & b.
+    auto sides = make_shared<quad_set>();
+    box(a, b, mat, *sides);
+    sides->set_solid(aabb(a, b));
+    sides->build();
+    return sides;
+}
+
+#endif
@@ -3,27 +3,44 @@
 
 #include "vec3.hpp"
 
-class ray{
+template <typename T>
+class ray_t{
 public :
-    ray(){};
+    ray_t(){};
 
-    ray(const point3& p, const vec3& v) 
-        : ray(p, v, 0){} ;
+    ray_t(const vec3_t<T>& p, const vec3_t<T>& v) 
+        : ray_t(p, v, 0){} ;
 
-    ray(const point3& p, const vec3& v, double time) 
+    ray_t(const vec3_t<T>& p, const vec3_t<T>& v, T time) 
         : orig(p), dir(v), tm(time){} ;
 
-    const point3 origin() const {return orig;}
-    const vec3 direction() const {return dir;}
-
-    point3 at (double t )const {return orig + t * dir ;}
-
-    double time () const {return tm ;}
+    const vec3_t<T> origin() const {return orig;}
+    const vec3_t<T> direction() const {return dir;}
+
+    vec3_t<T> at (T t )const {return orig + t * dir ;}
+
+    T time () const {return tm ;}
+
+    interval_t<T> hit_range() const {
+        // The distances along the ray at which hits count. Rays usually leave a surface, so the
+        // range starts just past the rounding error in the origin: 0.001 as in the book, or more
+        // when the origin's coordinates are so large that a few ulps of them exceed that (which
+        // happens in single precision).
+        const T t_min = T(0.001);
+        T size = std::fmax(std::fabs(orig[0]), std::fmax(std::fabs(orig[1]), std::fabs(orig[2])));
+        T error = 64 * std::numeric_limits<T>::epsilon() * size;    // As a distance
+        T length_squared = dir.length_squared();
+        if (error * error > t_min * t_min * length_squared)
+            return interval_t<T>(error / std::sqrt(length_squared), std::numeric_limits<T>::infinity());
+        return interval_t<T>(t_min, std::numeric_limits<T>::infinity());
+    }
         
 private :
-    point3 orig;
-    vec3 dir ;
-    double tm ;
+    vec3_t<T> orig;
+    vec3_t<T> dir ;
+    T tm ;
 };
 
-#endif 
\ No newline at end of file
+using ray = ray_t<real>;
+
+#endif 
@@ -0,0 +1,122 @@
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include "utilis.hpp"
+#include "aabb.hpp"
+#include "simd.hpp"
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+// Up to 64 coherent rays (e.g. one 8x8 tile of camera rays) traced together. Ray i is lane i of
+// the float arrays, which SIMD box tests read floatv::width rays at a time. Sets of rays inside a
+// packet are passed around as 64-bit masks, bit i standing for ray i.
+class ray_packet {
+  public:
+    static const int max_size = 64;
+
+    int size = 0;
+    ray rays[max_size];
+    double t_min[max_size];     // Start of the hit range, per ray: ray::hit_range(), as for a
+                                // ray traced on its own
+    double t_max[max_size];     // Closest hit so far, per ray
+
+    // Float copies for SIMD tests. Loops run over whole vectors; lanes past `size` hold zeros or
+    // stale values and are never selected by a mask.
+    float ox[max_size] = {}, oy[max_size] = {}, oz[max_size] = {};
+    float dx[max_size] = {}, dy[max_size] = {}, dz[max_size] = {};
+    float inv_dx[max_size] = {}, inv_dy[max_size] = {}, inv_dz[max_size] = {};
+    float t_min_f[max_size] = {}, t_max_f[max_size] = {};
+
+    void clear() { size = 0; }
+
+    void add(const ray& r) {
+        set(size++, r, r.hit_range());
+    }
+
+    void set(int i, const ray& r, const interval& range) {
+        rays[i] = r;
+        ox[i] = float(r.origin().x());
+        oy[i] = float(r.origin().y());
+        oz[i] = float(r.origin().z());
+        dx[i] = float(r.direction().x());
+        dy[i] = float(r.direction().y());
+        dz[i] = float(r.direction().z());
+        inv_dx[i] = safe_inverse(r.direction().x());
+        inv_dy[i] = safe_inverse(r.direction().y());
+        inv_dz[i] = safe_inverse(r.direction().z());
+        // The float copy is rounded down so that it never culls a box the double test would enter.
+        t_min[i] = range.min;
+        t_min_f[i] = std::nextafter(float(range.min), -std::numeric_limits<float>::infinity());
+        set_t_max(i, range.max);
+    }
+
+    void set_t_max(int i, double t) {
+        // The float copy is rounded up so that it never culls a box the double test would enter.
+        t_max[i] = t;
+        t_max_f[i] = std::nextafter(float(t), std::numeric_limits<float>::infinity());
+    }
+
+    uint64_t all() const { return size == 64 ? ~uint64_t(0) : (uint64_t(1) << size) - 1; }
+
+    uint64_t hits_box(const float box_min[3], const float box_max[3], uint64_t mask) const {
+        // Slab test of one box (see float_box) against floatv::width rays at a time. Returns the
+        // rays of `mask` that enter the box between t_min and their t_max.
+        uint64_t result = 0;
+        const uint64_t lane_bits = (uint64_t(1) << floatv::width) - 1;
+        // Widen the far slab slightly so float rounding cannot cull a real hit.
+        const floatv widen(1.0f + 2e-7f * 6);
+
+        for (int base = 0; base < size; base += floatv::width) {
+            if (!((mask >> base) & lane_bits))
+                continue;
+
+            floatv x = floatv::load(ox + base), idx = floatv::load(inv_dx + base);
+            floatv y = floatv::load(oy + base), idy = floatv::load(inv_dy + base);
+            floatv z = floatv::load(oz + base), idz = floatv::load(inv_dz + base);
+
+            floatv tx0 = (floatv(box_min[0]) - x) * idx, tx1 = (floatv(box_max[0]) - x) * idx;
+            floatv ty0 = (floatv(box_min[1]) - y) * idy, ty1 = (floatv(box_max[1]) - y) * idy;
+            floatv tz0 = (floatv(box_min[2]) - z) * idz, tz1 = (floatv(box_max[2]) - z) * idz;
+
+            floatv t_lo = floatv::load(t_min_f + base);
+            floatv t_enter = max(max(min(tx0, tx1), min(ty0, ty1)), max(min(tz0, tz1), t_lo));
+            floatv t_exit  = min(min(max(tx0, tx1), max(ty0, ty1)), max(tz0, tz1)) * widen;
+            t_exit = min(t_exit, floatv::load(t_max_f + base));
+
+            result |= uint64_t((t_enter <= t_exit).bits()) << base;
+        }
+        return result & mask;
+    }
+
+    static void float_box(const aabb& box, float box_min[3], float box_max[3]) {
+        // Float copy of box for hits_box(), rounded outwards.
+        for (int a = 0; a < 3; a++) {
+            box_min[a] = std::nextafter(float(box.axis_interval(a).min),
+                                        -std::numeric_limits<float>::infinity());
+            box_max[a] = std::nextafter(float(box.axis_interval(a).max),
+                                        +std::numeric_limits<float>::infinity());
+        }
+    }
+
+    static int count(uint64_t mask) {
+        int n = 0;
+        for (; mask; mask &= mask - 1) n++;
+        return n;
+    }
+
+    static int lowest(uint64_t mask) {
+        int i = 0;
+        while (!((mask >> i) & 1)) i++;
+        return i;
+    }
+
+  private:
+    static float safe_inverse(double d) {
+        // Keep the reciprocal finite so that 0 * inv_dir never produces a NaN.
+        double da = std::fabs(d) < 1e-30 ? std::copysign(1e-30, d) : d;
+        return float(1.0 / da);
+    }
+};
+
+#endif
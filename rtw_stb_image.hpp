@@ -10,6 +10,7 @@
 #define STBI_FAILURE_USERMSG
 #include "external/stb_image.h"
 
+#include "trace.hpp"
 #include <cstdlib>
 #include <iostream>
 
@@ -25,6 +26,7 @@ class rtw_image {
         // parent, on so on, for six levels up. If the image was not loaded successfully,
         // width() and height() will return 0.
 
+        trace_span load_span("texture load", "scene");
         auto filename = std::string(image_filename);
         auto imagedir = getenv("RTW_IMAGES");
 
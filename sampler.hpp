@@ -0,0 +1,351 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+// Sample generators for the camera and the path vertices. By default every random decision of a
+// path takes a fresh random_double(). With a sampler set on the camera (camera::pixel_sampler),
+// the decisions of one pixel sample read successive dimensions of a low-discrepancy point
+// instead: the pixel position, the lens and the time first, then a fixed block of dimensions per
+// bounce, so that the same decision of different samples is stratified against each other.
+//
+// The code that makes the decisions does not see the sampler: it calls sample_1d(), which reads
+// the calling thread's sample_stream, and the camera points that stream at the right pixel
+// sample and bounce before each one is traced.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Bit mixing for seeds and scrambles (Wellons' lowbias32).
+inline uint32_t hash_u32(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+inline uint32_t hash_u32(uint32_t a, uint32_t b) {
+    return hash_u32(a ^ (hash_u32(b) + 0x9e3779b9u + (a << 6) + (a >> 2)));
+}
+
+inline uint32_t reverse_bits(uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+    x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+    return x;
+}
+
+inline uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+    // A base-2 Owen scramble of x read as a binary fraction (most significant bit first), by the
+    // Laine-Karras hash, which permutes bits from the low end, applied to the reversed bits.
+    // Applied to a sample index instead, it maps every aligned block of 2^k indices onto another
+    // aligned block of 2^k, in shuffled order.
+    x = reverse_bits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverse_bits(x);
+}
+
+inline double u32_to_unit(uint32_t x) {
+    // [0, 2^32) -> [0, 1)
+    return x * (1.0 / 4294967296.0);
+}
+
+// A deterministic point set over pixels, sample indices and dimensions. Implementations are
+// stateless, so one sampler is shared by all render threads.
+class sampler {
+  public:
+    virtual ~sampler() = default;
+
+    // Dimension `dim` of sample `index` of pixel (i, j), in [0, 1).
+    virtual double sample(int i, int j, uint32_t index, uint32_t dim) const = 0;
+};
+
+// Where the calling thread is in the dimensions of the sample it is tracing.
+class sample_stream {
+  public:
+    // The camera has dimensions 0-7 (pixel position, lens and time, and three to spare) and
+    // bounce b the eight after those of bounce b-1. Blocks of eight keep each vertex's
+    // dimensions inside the blocks that the samplers below decorrelate from each other.
+    static const uint32_t camera_dims = 8;
+    static const uint32_t bounce_dims = 8;
+
+    void begin_sample(const sampler* source, int i, int j, uint32_t index) {
+        this->source = source;
+        this->i = i;
+        this->j = j;
+        this->index = index;
+        set_dims(0, camera_dims);
+    }
+
+    void begin_bounce(int bounce) {
+        uint32_t first = camera_dims + uint32_t(bounce) * bounce_dims;
+        set_dims(first, first + bounce_dims);
+    }
+
+    bool active() const { return source != nullptr; }
+
+    double next() {
+        if (!source)
+            return random_double();
+        if (dim < end)
+            return source->sample(i, j, index, dim++);
+
+        // The vertex used up its dimensions: go on with hashed values that no other vertex
+        // or sample shares, unstratified but still independent.
+        uint32_t h = hash_u32(hash_u32(uint32_t(i), uint32_t(j)), hash_u32(index, end));
+        return u32_to_unit(hash_u32(h, overflow++));
+    }
+
+  private:
+    const sampler* source = nullptr;
+    int i = 0, j = 0;
+    uint32_t index = 0;
+    uint32_t dim = 0, end = 0;
+    uint32_t overflow = 0;
+
+    void set_dims(uint32_t first, uint32_t last) {
+        dim = first;
+        end = last;
+        overflow = 0;
+    }
+};
+
+inline sample_stream& thread_sample_stream() {
+    thread_local sample_stream stream;
+    return stream;
+}
+
+// The next dimension of the current sample, or random_double() when no sampler is set.
+inline double sample_1d() {
+    return thread_sample_stream().next();
+}
+
+inline bool sampler_active() {
+    return thread_sample_stream().active();
+}
+
+// Sobol points with Owen scrambling, computed the way Burley describes in "Practical Hash-based
+// Owen Scrambling" (JCGT 2020): dimensions come in blocks of four, each block a 4D Sobol set
+// whose index is shuffled and whose values are scrambled by a hash-based nested uniform
+// permutation, seeded per pixel and per block. Any number of dimensions is available, and each
+// block is well stratified in all four dimensions for power-of-two sample counts.
+class sobol_sampler : public sampler {
+  public:
+    sobol_sampler(uint32_t seed = 0) : seed(seed) {}
+
+    double sample(int i, int j, uint32_t index, uint32_t dim) const override {
+        return sample_pixel_seed(hash_u32(hash_u32(uint32_t(i), uint32_t(j)), seed), index, dim);
+    }
+
+    // As sample(), with the per-pixel seed given.
+    static double sample_pixel_seed(uint32_t pixel_seed, uint32_t index, uint32_t dim) {
+        uint32_t block_seed = hash_u32(pixel_seed, dim / 4);
+        uint32_t shuffled = nested_uniform_scramble(index, block_seed);
+        uint32_t x = sobol(shuffled, dim % 4);
+        return u32_to_unit(nested_uniform_scramble(x, hash_u32(block_seed, dim % 4)));
+    }
+
+  private:
+    uint32_t seed;
+
+    static uint32_t sobol(uint32_t index, uint32_t dim) {
+        // The shuffled indices use all 32 bits, so the matrix product goes a byte at a time.
+        static const direction_numbers matrices;
+        const uint32_t (*table)[256] = matrices.byte_table[dim];
+        return table[0][index & 255] ^ table[1][(index >> 8) & 255]
+             ^ table[2][(index >> 16) & 255] ^ table[3][index >> 24];
+    }
+
+    // Generator matrices of the four dimensions, one column per index bit. Dimension 0 is the
+    // van der Corput sequence; 1-3 are the first dimensions of Joe and Kuo's new-joe-kuo-6.21201
+    // table (degree s, coefficients a, initial numbers m). byte_table[d][b][x] is the product of
+    // the matrix with the index whose byte b is x and whose other bytes are zero.
+    struct direction_numbers {
+        uint32_t v[4][32];
+        uint32_t byte_table[4][4][256];
+
+        direction_numbers() {
+            const uint32_t s[4] = { 0, 1, 2, 3 };
+            const uint32_t a[4] = { 0, 0, 1, 1 };
+            const uint32_t m[4][3] = { {}, { 1 }, { 1, 3 }, { 1, 3, 1 } };
+
+            for (int k = 0; k < 32; k++)
+                v[0][k] = 1u << (31 - k);
+
+            for (int d = 1; d < 4; d++) {
+                for (uint32_t k = 0; k < 32; k++) {
+                    if (k < s[d]) {
+                        v[d][k] = m[d][k] << (31 - k);
+                        continue;
+                    }
+                    v[d][k] = v[d][k - s[d]] ^ (v[d][k - s[d]] >> s[d]);
+                    for (uint32_t b = 1; b < s[d]; b++)
+                        if ((a[d] >> (s[d] - 1 - b)) & 1)
+                            v[d][k] ^= v[d][k - b];
+                }
+            }
+
+            for (int d = 0; d < 4; d++)
+                for (int b = 0; b < 4; b++)
+                    for (uint32_t x = 0; x < 256; x++) {
+                        uint32_t product = 0;
+                        for (int bit = 0; bit < 8; bit++)
+                            if ((x >> bit) & 1)
+                                product ^= v[d][8 * b + bit];
+                        byte_table[d][b][x] = product;
+                    }
+        }
+    };
+};
+
+// The Halton sequence, dimension d being the radical inverse of the sample index in the d-th
+// prime base. Its high-prime dimensions need far more samples than a pixel gets before they are
+// evenly spread, so dimensions come in blocks of eight that all use the first eight primes, each
+// block (and pixel) reading its own shuffled stretch of the sequence: the sample index is
+// shuffled by nested_uniform_scramble, seeded per pixel and block, as the Sobol sampler does.
+class halton_sampler : public sampler {
+  public:
+    halton_sampler(uint32_t seed = 0) : seed(seed) {}
+
+    double sample(int i, int j, uint32_t index, uint32_t dim) const override {
+        uint32_t pixel_seed = hash_u32(hash_u32(uint32_t(i), uint32_t(j)), seed);
+        uint32_t shuffled = nested_uniform_scramble(index, hash_u32(pixel_seed, dim / 8));
+        return radical_inverse(primes[dim % 8], shuffled);
+    }
+
+  private:
+    uint32_t seed;
+
+    static constexpr uint32_t primes[8] = { 2, 3, 5, 7, 11, 13, 17, 19 };
+
+    static double radical_inverse(uint32_t base, uint32_t index) {
+        // The digits of index in `base`, mirrored about the radix point.
+        if (base == 2)
+            return u32_to_unit(reverse_bits(index));
+        const double inv_base = 1.0 / base;
+        double inv_base_n = 1;
+        uint64_t reversed = 0;
+        while (index) {
+            uint32_t next = index / base;
+            reversed = reversed * base + (index - next * base);
+            inv_base_n *= inv_base;
+            index = next;
+        }
+        double x = reversed * inv_base_n;
+        return x < 1 ? x : std::nextafter(1.0, 0.0);
+    }
+};
+
+// Blue-noise dithered sampling (Georgiev and Fajardo, 2016): every pixel uses the same Owen-Sobol
+// points, rotated by the value of a blue-noise mask at the pixel. Neighbouring pixels then get
+// very different rotations, which pushes the remaining error towards high frequencies, where it
+// reads as fine grain instead of blotches. Each dimension looks the mask up at its own offset.
+class blue_noise_sampler : public sampler {
+  public:
+    static const int mask_size = 64;
+
+    blue_noise_sampler(uint32_t seed = 0) : seed(seed), mask(void_and_cluster(seed)) {}
+
+    double sample(int i, int j, uint32_t index, uint32_t dim) const override {
+        uint32_t h = hash_u32(seed, dim);
+        int x = (i + int(h & (mask_size - 1))) & (mask_size - 1);
+        int y = (j + int((h >> 8) & (mask_size - 1))) & (mask_size - 1);
+
+        double value = sobol_sampler::sample_pixel_seed(seed, index, dim) + mask[y * mask_size + x];
+        return value >= 1 ? value - 1 : value;
+    }
+
+  private:
+    uint32_t seed;
+    std::vector<double> mask;   // mask_size^2 values, each of (k + 0.5) / mask_size^2 once
+
+    static std::vector<double> void_and_cluster(uint32_t seed) {
+        // Ulichney's void-and-cluster method on a torus: rank the pixels so that the first n of
+        // them, for every n, are spread as evenly as possible. The "energy" of a pixel is the sum
+        // of a Gaussian over the distances to the pixels already chosen; the tightest cluster is
+        // the chosen pixel of highest energy and the largest void the free pixel of lowest.
+        const int size = mask_size, n = size * size;
+        const double sigma = 1.5;
+
+        std::vector<double> kernel(n);
+        for (int y = 0; y < size; y++)
+            for (int x = 0; x < size; x++) {
+                int dx = std::min(x, size - x), dy = std::min(y, size - y);
+                kernel[y * size + x] = std::exp(-(dx*dx + dy*dy) / (2 * sigma * sigma));
+            }
+
+        std::vector<char> chosen(n, 0);
+        std::vector<double> energy(n, 0.0);
+        auto toggle = [&](int p, double sign) {
+            chosen[p] = sign > 0;
+            int px = p % size, py = p / size;
+            for (int y = 0; y < size; y++)
+                for (int x = 0; x < size; x++)
+                    energy[y * size + x] += sign * kernel[((y - py) & (size - 1)) * size
+                                                          + ((x - px) & (size - 1))];
+        };
+        auto extreme = [&](bool in_set, bool highest) {
+            int best = -1;
+            for (int p = 0; p < n; p++) {
+                if (bool(chosen[p]) != in_set)
+                    continue;
+                if (best < 0 || (highest ? energy[p] > energy[best] : energy[p] < energy[best]))
+                    best = p;
+            }
+            return best;
+        };
+
+        // A random initial set of a tenth of the pixels, relaxed by moving its tightest cluster
+        // into its largest void until that no longer changes anything.
+        const int initial = n / 10;
+        for (int k = 0, p = 0; k < initial; k++) {
+            do p = int(hash_u32(seed, uint32_t(k + p * 7919)) % uint32_t(n));
+            while (chosen[p]);
+            toggle(p, +1);
+        }
+        for (int iteration = 0; iteration < n; iteration++) {
+            int cluster = extreme(true, true);
+            toggle(cluster, -1);
+            int void_pixel = extreme(false, false);
+            toggle(void_pixel, +1);
+            if (void_pixel == cluster)
+                break;
+        }
+        std::vector<char> initial_set = chosen;
+        std::vector<double> initial_energy = energy;
+
+        // Ranks below `initial`: remove tightest clusters, last rank first.
+        std::vector<int> rank(n);
+        for (int r = initial - 1; r >= 0; r--) {
+            int cluster = extreme(true, true);
+            rank[cluster] = r;
+            toggle(cluster, -1);
+        }
+
+        // The rest: fill the largest voids in turn. On a torus the Gaussian sums to the same total
+        // at every pixel, so once the set is more than half full this is also the tightest
+        // cluster of the free pixels, as the method prescribes.
+        chosen = initial_set;
+        energy = initial_energy;
+        for (int r = initial; r < n; r++) {
+            int void_pixel = extreme(false, false);
+            rank[void_pixel] = r;
+            toggle(void_pixel, +1);
+        }
+
+        std::vector<double> values(n);
+        for (int p = 0; p < n; p++)
+            values[p] = (rank[p] + 0.5) / n;
+        return values;
+    }
+};
+
+#endif
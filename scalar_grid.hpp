@@ -0,0 +1,163 @@
+#ifndef SCALAR_GRID_H
+#define SCALAR_GRID_H
+
+#include "utilis.hpp"
+#include "aabb.hpp"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// A dense 3D grid of float samples laid over an axis-aligned box. The samples sit on the grid
+// nodes, so a grid with n nodes along an axis covers that axis with n-1 cells.
+class scalar_grid {
+  public:
+    enum class filter { trilinear, tricubic };
+
+    scalar_grid() {}
+
+    scalar_grid(const aabb& bounds, int resolution) : bounds(bounds) {
+        // `resolution` is the number of cells along the longest axis of the box. The other two
+        // axes get the same cell size, so the cells are (nearly) cubes.
+        resolution = std::max(resolution, 1);
+        double longest = std::fmax(bounds.x.size(), std::fmax(bounds.y.size(), bounds.z.size()));
+        double cell = longest / resolution;
+
+        for (int axis = 0; axis < 3; axis++) {
+            const interval& ax = bounds.axis_interval(axis);
+            n[axis] = std::max(2, int(std::ceil(ax.size() / cell)) + 1);
+            inv_spacing[axis] = (n[axis] - 1) / ax.size();
+        }
+
+        data.assign(size_t(n[0]) * n[1] * n[2], 0.0f);
+    }
+
+    template <typename Fn>
+    void fill(const Fn& field) {
+        // Evaluates field(p) at every node. Z slices are shared out between the hardware threads,
+        // which is safe as long as `field` only reads shared state.
+        unsigned n_threads = std::thread::hardware_concurrency();
+        if (n_threads == 0) n_threads = 4;
+        n_threads = std::min<unsigned>(n_threads, n[2]);
+
+        auto worker = [&](int k_start, int k_end) {
+            for (int k = k_start; k < k_end; k++)
+                for (int j = 0; j < n[1]; j++)
+                    for (int i = 0; i < n[0]; i++)
+                        data[index(i, j, k)] = float(field(node_position(i, j, k)));
+        };
+
+        std::vector<std::thread> threads;
+        int slices_per_thread = n[2] / n_threads;
+        int k_start = 0;
+        for (unsigned t = 0; t < n_threads; t++) {
+            int k_end = (t == n_threads - 1) ? n[2] : k_start + slices_per_thread;
+            threads.emplace_back(worker, k_start, k_end);
+            k_start = k_end;
+        }
+        for (auto& th : threads) th.join();
+    }
+
+    bool contains(const point3& p) const {
+        return bounds.x.contains(p.x()) && bounds.y.contains(p.y()) && bounds.z.contains(p.z());
+    }
+
+    double sample(const point3& p, filter mode) const {
+        // Returns the filtered grid value at p. Points outside the box are clamped to its faces.
+        double g[3];
+        int    i[3];
+        double f[3];
+        for (int axis = 0; axis < 3; axis++) {
+            g[axis] = (p[axis] - bounds.axis_interval(axis).min) * inv_spacing[axis];
+            g[axis] = interval(0, n[axis] - 1).clamp(g[axis]);
+            i[axis] = std::min(int(g[axis]), n[axis] - 2);
+            f[axis] = g[axis] - i[axis];
+        }
+
+        return mode == filter::tricubic ? tricubic(i, f) : trilinear(i, f);
+    }
+
+    size_t memory_bytes() const { return data.size() * sizeof(float); }
+    size_t node_count() const { return data.size(); }
+    const aabb& bounding_box() const { return bounds; }
+
+  private:
+    aabb bounds;
+    int n[3] = {0, 0, 0};              // Node count along each axis
+    double inv_spacing[3] = {0, 0, 0}; // Nodes per world unit along each axis
+    std::vector<float> data;
+
+    size_t index(int i, int j, int k) const {
+        return (size_t(k) * n[1] + j) * n[0] + i;
+    }
+
+    float at(int i, int j, int k) const {
+        i = std::clamp(i, 0, n[0] - 1);
+        j = std::clamp(j, 0, n[1] - 1);
+        k = std::clamp(k, 0, n[2] - 1);
+        return data[index(i, j, k)];
+    }
+
+    point3 node_position(int i, int j, int k) const {
+        return point3(bounds.x.min + i / inv_spacing[0],
+                      bounds.y.min + j / inv_spacing[1],
+                      bounds.z.min + k / inv_spacing[2]);
+    }
+
+    double trilinear(const int i[3], const double f[3]) const {
+        // sample() keeps i within [0, n-2], so all eight corners are inside the grid.
+        const size_t dx = 1, dy = size_t(n[0]), dz = size_t(n[0]) * n[1];
+        const float* c = &data[index(i[0], i[1], i[2])];
+
+        double c00 = c[0]       + f[0] * (c[dx]           - c[0]);
+        double c10 = c[dy]      + f[0] * (c[dy + dx]      - c[dy]);
+        double c01 = c[dz]      + f[0] * (c[dz + dx]      - c[dz]);
+        double c11 = c[dz + dy] + f[0] * (c[dz + dy + dx] - c[dz + dy]);
+
+        double c0 = c00 + f[1] * (c10 - c00);
+        double c1 = c01 + f[1] * (c11 - c01);
+        return c0 + f[2] * (c1 - c0);
+    }
+
+    static void catmull_rom_weights(double t, double w[4]) {
+        // Catmull-Rom spline weights for the nodes at -1, 0, +1, +2 around the cell.
+        auto t2 = t*t;
+        auto t3 = t2*t;
+        w[0] = 0.5 * (-t3 + 2*t2 - t);
+        w[1] = 0.5 * (3*t3 - 5*t2 + 2);
+        w[2] = 0.5 * (-3*t3 + 4*t2 + t);
+        w[3] = 0.5 * (t3 - t2);
+    }
+
+    double tricubic(const int i[3], const double f[3]) const {
+        double wx[4], wy[4], wz[4];
+        catmull_rom_weights(f[0], wx);
+        catmull_rom_weights(f[1], wy);
+        catmull_rom_weights(f[2], wz);
+
+        // Away from the faces the whole 4x4x4 neighbourhood is in range and can be read with
+        // plain strides; only cells on the border pay for per-node clamping.
+        bool interior = i[0] >= 1 && i[0] + 2 < n[0]
+                     && i[1] >= 1 && i[1] + 2 < n[1]
+                     && i[2] >= 1 && i[2] + 2 < n[2];
+
+        double accum = 0.0;
+        for (int dk = 0; dk < 4; dk++) {
+            double plane = 0.0;
+            for (int dj = 0; dj < 4; dj++) {
+                double row = 0.0;
+                if (interior) {
+                    const float* c = &data[index(i[0] - 1, i[1] + dj - 1, i[2] + dk - 1)];
+                    row = wx[0]*c[0] + wx[1]*c[1] + wx[2]*c[2] + wx[3]*c[3];
+                } else {
+                    for (int di = 0; di < 4; di++)
+                        row += wx[di] * at(i[0] + di - 1, i[1] + dj - 1, i[2] + dk - 1);
+                }
+                plane += wy[dj] * row;
+            }
+            accum += wz[dk] * plane;
+        }
+        return accum;
+    }
+};
+
+#endif
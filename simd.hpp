@@ -0,0 +1,195 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// A thin wrapper over the widest float vector the compiler is allowed to use: 16 lanes with
+// AVX-512, 8 with AVX, 4 with SSE2, and a plain 4-lane array otherwise. Build with
+// -march=native (or -mavx2, -mavx512f) to get the wider paths; the code that uses floatv only
+// depends on floatv::width.
+//
+// floatv holds `width` floats, maskv holds the result of a lane-wise comparison. maskv::bits()
+// packs the mask into an integer with lane i in bit i, for scalar code that walks the hit lanes.
+
+#if defined(__AVX512F__)
+    #include <immintrin.h>
+    #define RT_SIMD_AVX512
+#elif defined(__AVX__)
+    #include <immintrin.h>
+    #define RT_SIMD_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define RT_SIMD_SSE
+#endif
+
+#include <cmath>
+
+#if defined(RT_SIMD_AVX512)
+
+struct maskv {
+    __mmask16 m;
+    int bits() const { return int(m); }
+    maskv operator&(maskv o) const { return { __mmask16(m & o.m) }; }
+    maskv operator|(maskv o) const { return { __mmask16(m | o.m) }; }
+};
+
+struct floatv {
+    static const int width = 16;
+    __m512 v;
+
+    floatv() {}
+    floatv(__m512 v) : v(v) {}
+    floatv(float f) : v(_mm512_set1_ps(f)) {}
+
+    static floatv load(const float* p) { return _mm512_loadu_ps(p); }
+    void store(float* p) const { _mm512_storeu_ps(p, v); }
+
+    friend floatv operator+(floatv a, floatv b) { return _mm512_add_ps(a.v, b.v); }
+    friend floatv operator-(floatv a, floatv b) { return _mm512_sub_ps(a.v, b.v); }
+    friend floatv operator*(floatv a, floatv b) { return _mm512_mul_ps(a.v, b.v); }
+    friend floatv operator/(floatv a, floatv b) { return _mm512_div_ps(a.v, b.v); }
+    friend floatv min(floatv a, floatv b) { return _mm512_min_ps(a.v, b.v); }
+    friend floatv max(floatv a, floatv b) { return _mm512_max_ps(a.v, b.v); }
+    friend floatv sqrt(floatv a) { return _mm512_sqrt_ps(a.v); }
+    friend floatv abs(floatv a) { return _mm512_abs_ps(a.v); }
+
+    friend maskv operator<(floatv a, floatv b)  { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ) }; }
+    friend maskv operator<=(floatv a, floatv b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ) }; }
+    friend maskv operator>(floatv a, floatv b)  { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ) }; }
+    friend maskv operator>=(floatv a, floatv b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_GE_OQ) }; }
+
+    friend floatv select(maskv m, floatv a, floatv b) { return _mm512_mask_blend_ps(m.m, b.v, a.v); }
+};
+
+#elif defined(RT_SIMD_AVX)
+
+struct maskv {
+    __m256 m;
+    int bits() const { return _mm256_movemask_ps(m); }
+    maskv operator&(maskv o) const { return { _mm256_and_ps(m, o.m) }; }
+    maskv operator|(maskv o) const { return { _mm256_or_ps(m, o.m) }; }
+};
+
+struct floatv {
+    static const int width = 8;
+    __m256 v;
+
+    floatv() {}
+    floatv(__m256 v) : v(v) {}
+    floatv(float f) : v(_mm256_set1_ps(f)) {}
+
+    static floatv load(const float* p) { return _mm256_loadu_ps(p); }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+
+    friend floatv operator+(floatv a, floatv b) { return _mm256_add_ps(a.v, b.v); }
+    friend floatv operator-(floatv a, floatv b) { return _mm256_sub_ps(a.v, b.v); }
+    friend floatv operator*(floatv a, floatv b) { return _mm256_mul_ps(a.v, b.v); }
+    friend floatv operator/(floatv a, floatv b) { return _mm256_div_ps(a.v, b.v); }
+    friend floatv min(floatv a, floatv b) { return _mm256_min_ps(a.v, b.v); }
+    friend floatv max(floatv a, floatv b) { return _mm256_max_ps(a.v, b.v); }
+    friend floatv sqrt(floatv a) { return _mm256_sqrt_ps(a.v); }
+    friend floatv abs(floatv a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+
+    friend maskv operator<(floatv a, floatv b)  { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+    friend maskv operator<=(floatv a, floatv b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; }
+    friend maskv operator>(floatv a, floatv b)  { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+    friend maskv operator>=(floatv a, floatv b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+
+    friend floatv select(maskv m, floatv a, floatv b) { return _mm256_blendv_ps(b.v, a.v, m.m); }
+};
+
+#elif defined(RT_SIMD_SSE)
+
+struct maskv {
+    __m128 m;
+    int bits() const { return _mm_movemask_ps(m); }
+    maskv operator&(maskv o) const { return { _mm_and_ps(m, o.m) }; }
+    maskv operator|(maskv o) const { return { _mm_or_ps(m, o.m) }; }
+};
+
+struct floatv {
+    static const int width = 4;
+    __m128 v;
+
+    floatv() {}
+    floatv(__m128 v) : v(v) {}
+    floatv(float f) : v(_mm_set1_ps(f)) {}
+
+    static floatv load(const float* p) { return _mm_loadu_ps(p); }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+
+    friend floatv operator+(floatv a, floatv b) { return _mm_add_ps(a.v, b.v); }
+    friend floatv operator-(floatv a, floatv b) { return _mm_sub_ps(a.v, b.v); }
+    friend floatv operator*(floatv a, floatv b) { return _mm_mul_ps(a.v, b.v); }
+    friend floatv operator/(floatv a, floatv b) { return _mm_div_ps(a.v, b.v); }
+    friend floatv min(floatv a, floatv b) { return _mm_min_ps(a.v, b.v); }
+    friend floatv max(floatv a, floatv b) { return _mm_max_ps(a.v, b.v); }
+    friend floatv sqrt(floatv a) { return _mm_sqrt_ps(a.v); }
+    friend floatv abs(floatv a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+
+    friend maskv operator<(floatv a, floatv b)  { return { _mm_cmplt_ps(a.v, b.v) }; }
+    friend maskv operator<=(floatv a, floatv b) { return { _mm_cmple_ps(a.v, b.v) }; }
+    friend maskv operator>(floatv a, floatv b)  { return { _mm_cmpgt_ps(a.v, b.v) }; }
+    friend maskv operator>=(floatv a, floatv b) { return { _mm_cmpge_ps(a.v, b.v) }; }
+
+    friend floatv select(maskv m, floatv a, floatv b) {
+        return _mm_or_ps(_mm_and_ps(m.m, a.v), _mm_andnot_ps(m.m, b.v));
+    }
+};
+
+#else
+
+// Portable fallback: plain loops that the compiler may still vectorise.
+struct maskv {
+    int m;
+    int bits() const { return m; }
+    maskv operator&(maskv o) const { return { m & o.m }; }
+    maskv operator|(maskv o) const { return { m | o.m }; }
+};
+
+struct floatv {
+    static const int width = 4;
+    float v[width];
+
+    floatv() {}
+    floatv(float f) { for (int i = 0; i < width; i++) v[i] = f; }
+
+    static floatv load(const float* p) { floatv r; for (int i = 0; i < width; i++) r.v[i] = p[i]; return r; }
+    void store(float* p) const { for (int i = 0; i < width; i++) p[i] = v[i]; }
+
+    template <typename F>
+    static floatv map(floatv a, floatv b, F f) {
+        floatv r;
+        for (int i = 0; i < width; i++) r.v[i] = f(a.v[i], b.v[i]);
+        return r;
+    }
+
+    template <typename F>
+    static maskv compare(floatv a, floatv b, F f) {
+        int m = 0;
+        for (int i = 0; i < width; i++) m |= f(a.v[i], b.v[i]) ? (1 << i) : 0;
+        return { m };
+    }
+
+    friend floatv operator+(floatv a, floatv b) { return map(a, b, [](float x, float y) { return x + y; }); }
+    friend floatv operator-(floatv a, floatv b) { return map(a, b, [](float x, float y) { return x - y; }); }
+    friend floatv operator*(floatv a, floatv b) { return map(a, b, [](float x, float y) { return x * y; }); }
+    friend floatv operator/(floatv a, floatv b) { return map(a, b, [](float x, float y) { return x / y; }); }
+    friend floatv min(floatv a, floatv b) { return map(a, b, [](float x, float y) { return x < y ? x : y; }); }
+    friend floatv max(floatv a, floatv b) { return map(a, b, [](float x, float y) { return x > y ? x : y; }); }
+    friend floatv sqrt(floatv a) { return map(a, a, [](float x, float) { return std::sqrt(x); }); }
+    friend floatv abs(floatv a) { return map(a, a, [](float x, float) { return std::fabs(x); }); }
+
+    friend maskv operator<(floatv a, floatv b)  { return compare(a, b, [](float x, float y) { return x < y; }); }
+    friend maskv operator<=(floatv a, floatv b) { return compare(a, b, [](float x, float y) { return x <= y; }); }
+    friend maskv operator>(floatv a, floatv b)  { return compare(a, b, [](float x, float y) { return x > y; }); }
+    friend maskv operator>=(floatv a, floatv b) { return compare(a, b, [](float x, float y) { return x >= y; }); }
+
+    friend floatv select(maskv m, floatv a, floatv b) {
+        floatv r;
+        for (int i = 0; i < width; i++) r.v[i] = (m.m >> i) & 1 ? a.v[i] : b.v[i];
+        return r;
+    }
+};
+
+#endif
+
+#endif
@@ -1,5 +1,5 @@
 #ifndef SPHERE_H
-#define spHERE_H
+#define SPHERE_H
 
 #include "vec3.hpp"
 #include "hittable.hpp"
@@ -27,6 +27,11 @@ class sphere : public hittable {
     }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return intersect_and_finish(r, ray_t, rec);
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        RT_COUNT_TEST(sphere);
         point3 current_center = center.at(r.time());
         vec3 oc = current_center - r.origin();
         auto a = r.direction().length_squared();
@@ -48,20 +53,44 @@ class sphere : public hittable {
         }
 
         rec.t = root;
+        rec.pending = this;
+        return true;
+    }
+
+    void finish_hit(const ray& r, hit_record& rec) const override {
         rec.p = r.at(rec.t);
-        vec3 outward_normal = (rec.p - current_center) / radius;
+        vec3 outward_normal = (rec.p - center.at(r.time())) / radius;
         rec.set_face_normal(r, outward_normal);
-        get_sphere_uv(outward_normal, rec.u, rec.v);
+        rec.deferred_uv = uv_from_normal;
         rec.mat = mat;//一種物體只會有一種材質
-        return true;
     }
     aabb bounding_box() const override {return bbox;}
 
+    bool is_convex() const override { return true; }
+
+    bool convex_span(const ray& r, interval& inside) const override {
+        // Both roots of intersect()'s quadratic, computed the same way.
+        point3 current_center = center.at(r.time());
+        vec3 oc = current_center - r.origin();
+        auto a = r.direction().length_squared();
+        auto b = -2 * dot(r.direction(), oc);
+        auto c = oc.length_squared() - radius*radius;
+
+        auto discriminant = b*b - 4*a*c;
+        if (discriminant < 0)
+            return false;
+
+        auto sqrtd = std::sqrt(discriminant);
+        inside = interval((- b - sqrtd) / (2*a), (- b + sqrtd) / (2*a));
+        return true;
+    }
+
        double pdf_value(const point3& origin, const vec3& direction) const override {
         // This method only works for stationary spheres.
 
         hit_record rec;
-        if (!this->hit(ray(origin, direction), interval(0.001, infinity), rec))
+        ray r(origin, direction);
+        if (!this->intersect(r, r.hit_range(), rec))
             return 0;
 
         auto dist_squared = (center.at(0) - origin).length_squared();
@@ -78,32 +107,41 @@ class sphere : public hittable {
         return uvw.transform(random_to_sphere(radius, distance_squared));
     }
   private:
+    friend class sphere_set;
+
     ray center;
-    double radius;
+    real radius;
     shared_ptr<material> mat;
     aabb bbox;
-    static void get_sphere_uv(const point3& p, double& u , double& v){
+    static void uv_from_normal(const hit_record& rec, real& u, real& v) {
+        // Deferred UVs (see hit_record::deferred_uv): the outward normal is the face normal,
+        // flipped back for hits from inside.
+        get_sphere_uv(rec.front_face ? rec.normal : -rec.normal, u, v);
+    }
+
+    static void get_sphere_uv(const point3& p, real& u , real& v){
         // p: a given point on the sphere of radius one, centered at the origin.
         // u: returned value [0,1] of angle around the Y axis from X=-1.
         // v: returned value [0,1] of angle from Y=-1 to Y=+1.
         //     <1 0 0> yields <0.50 0.50>       <-1  0  0> yields <0.00 0.50>
         //     <0 1 0> yields <0.50 1.00>       < 0 -1  0> yields <0.50 0.00>
         //     <0 0 1> yields <0.25 0.50>       < 0  0 -1> yields <0.75 0.50>
-        auto theta = std::acos(-p.y());
-        auto phi = std::atan2(-p.z(), p.x()) + pi;
+        auto theta = fast_acos(-p.y());
+        auto phi = fast_atan2(-p.z(), p.x()) + pi;
 
         u = phi / (2*pi);
         v = theta / pi;
     }
     
     static vec3 random_to_sphere(double radius, double distance_squared) {
-        auto r1 = random_double();
-        auto r2 = random_double();
+        auto r1 = sample_1d();
+        auto r2 = sample_1d();
         auto z = 1 + r2*(std::sqrt(1-radius*radius/distance_squared) - 1);
 
-        auto phi = 2*pi*r1;
-        auto x = std::cos(phi) * std::sqrt(1-z*z);
-        auto y = std::sin(phi) * std::sqrt(1-z*z);
+        double phi = 2*pi*r1, sin_phi, cos_phi;
+        fast_sincos(phi, sin_phi, cos_phi);
+        auto x = cos_phi * std::sqrt(1-z*z);
+        auto y = sin_phi * std::sqrt(1-z*z);
 
         return vec3(x, y, z);
     }
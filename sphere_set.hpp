@@ -0,0 +1,260 @@
+#ifndef SPHERE_SET_H
+#define SPHERE_SET_H
+
+#include "hittable.hpp"
+#include "hittable_list.hpp"
+#include "sphere.hpp"
+#include "flat_bvh.hpp"
+#include "simd.hpp"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Many spheres as one hittable, for particle and point-cloud style scenes. Centres, motion and
+// radii are stored as structure-of-arrays floats in BVH leaf order, and each BVH leaf (up to
+// floatv::width spheres) is tested with one SIMD pass.
+//
+// The float pass is only a conservative filter: its error bounds are padded so it never drops a
+// sphere that sphere::hit would hit. Spheres that survive it are intersected again in full
+// precision (real) with exactly the arithmetic of sphere::hit, so the hit distance, point, normal and UV
+// are the same as for the equivalent sphere objects, moving spheres included.
+class sphere_set : public hittable {
+  public:
+    sphere_set(const hittable_list& list) {
+        for (const auto& object : list.objects) {
+            auto s = std::dynamic_pointer_cast<sphere>(object);
+            if (!s) {
+                std::cerr << "ERROR: sphere_set only holds spheres; skipping another object.\n";
+                continue;
+            }
+            add(*s);
+        }
+        build();
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return intersect_and_finish(r, ray_t, rec);
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        const ray_setup rs(r);
+        uint32_t hit_index = 0;
+
+        bool hit_anything = bvh.traverse_leaves(r, ray_t,
+            [&](uint32_t first, uint32_t count, interval& t_range) {
+                int candidates = candidate_mask(rs, first, t_range) & ((1 << count) - 1);
+                bool hit_leaf = false;
+                while (candidates) {
+                    int lane = lowest_bit(candidates);
+                    candidates &= candidates - 1;
+
+                    real t;
+                    if (intersect_exact(r, first + lane, t_range, t)) {
+                        t_range.max = t;
+                        hit_index = first + lane;
+                        hit_leaf = true;
+                    }
+                }
+                return hit_leaf;
+            });
+
+        if (!hit_anything)
+            return false;
+
+        rec.t = ray_t.max;
+        rec.prim = hit_index;
+        rec.pending = this;
+        return true;
+    }
+
+    void finish_hit(const ray& r, hit_record& rec) const override {
+        // The same hit record sphere::hit would produce.
+        point3 current_center = centers[rec.prim].at(r.time());
+        rec.p = r.at(rec.t);
+        vec3 outward_normal = (rec.p - current_center) / radii[rec.prim];
+        rec.set_face_normal(r, outward_normal);
+        rec.deferred_uv = sphere::uv_from_normal;
+        rec.mat = materials[material_index[rec.prim]];
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    size_t sphere_count() const { return radii.size(); }
+
+    size_t memory_bytes() const {
+        return (cx.capacity() + cy.capacity() + cz.capacity() + mx.capacity() + my.capacity()
+              + mz.capacity() + radius_f.capacity() + extent.capacity()) * sizeof(float)
+             + centers.capacity() * sizeof(ray) + radii.capacity() * sizeof(real)
+             + material_index.capacity() * sizeof(uint32_t)
+             + materials.capacity() * sizeof(shared_ptr<material>)
+             + bvh.memory_bytes();
+    }
+
+  private:
+    // Float copies of the ray, broadcast once per hit() call.
+    struct ray_setup {
+        floatv ox, oy, oz, dx, dy, dz;
+        floatv a;           // |d|^2
+        floatv length;      // |d|
+        floatv time;
+        floatv origin_size; // max(|ox|, |oy|, |oz|), for the error bound
+
+        ray_setup(const ray& r)
+          : ox(float(r.origin().x())), oy(float(r.origin().y())), oz(float(r.origin().z())),
+            dx(float(r.direction().x())), dy(float(r.direction().y())),
+            dz(float(r.direction().z())),
+            a(float(r.direction().length_squared())),
+            length(float(r.direction().length())),
+            time(float(r.time())),
+            origin_size(float(std::fmax(std::fabs(r.origin().x()),
+                              std::fmax(std::fabs(r.origin().y()), std::fabs(r.origin().z())))))
+        {}
+    };
+
+    // SIMD copy, in leaf order and padded by one vector so a leaf load never runs off the end.
+    std::vector<float> cx, cy, cz;          // Centre at time 0
+    std::vector<float> mx, my, mz;          // Motion from time 0 to time 1
+    std::vector<float> radius_f;
+    std::vector<float> extent;              // Largest centre coordinate plus radius, for error bounds
+    bool has_motion = false;
+
+    // Exact copy, in the same order, used to refine the candidates.
+    std::vector<ray> centers;
+    std::vector<real> radii;
+    std::vector<uint32_t> material_index;
+    std::vector<shared_ptr<material>> materials;
+    std::unordered_map<const material*, uint32_t> material_ids;    // Into materials; add() only
+
+    flat_bvh bvh;
+    aabb bbox;
+
+    void add(const sphere& s) {
+        // Materials are usually shared by many spheres, so keep one pointer per distinct one.
+        auto found = material_ids.emplace(s.mat.get(), uint32_t(materials.size()));
+        uint32_t mat_id = found.first->second;
+        if (found.second)
+            materials.push_back(s.mat);
+
+        centers.push_back(s.center);
+        radii.push_back(s.radius);
+        material_index.push_back(mat_id);
+        if (s.center.direction().length_squared() > 0)
+            has_motion = true;
+    }
+
+    void build() {
+        // Every sphere is in, so the material lookup is no longer needed.
+        std::unordered_map<const material*, uint32_t>().swap(material_ids);
+
+        size_t n = radii.size();
+        std::vector<flat_bvh::bounds3> bounds;
+        bounds.reserve(n);
+        for (size_t i = 0; i < n; i++) {
+            auto rvec = vec3(radii[i], radii[i], radii[i]);
+            aabb box1(centers[i].at(0) - rvec, centers[i].at(0) + rvec);
+            aabb box2(centers[i].at(1) - rvec, centers[i].at(1) + rvec);
+            bounds.emplace_back(aabb(box1, box2));
+        }
+
+        bvh = flat_bvh(bounds, floatv::width);
+        bbox = bvh.bounding_box();
+
+        // Put every leaf's spheres next to each other, then fill the SIMD arrays in that order.
+        const auto& order = bvh.primitive_order();
+        permute(centers, order);
+        permute(radii, order);
+        permute(material_index, order);
+
+        size_t padded = n + floatv::width;
+        for (auto* v : { &cx, &cy, &cz, &mx, &my, &mz, &radius_f, &extent })
+            v->assign(padded, 0.0f);
+
+        for (size_t i = 0; i < n; i++) {
+            point3 c0 = centers[i].origin();
+            vec3 motion = centers[i].direction();
+            cx[i] = float(c0.x());      cy[i] = float(c0.y());      cz[i] = float(c0.z());
+            mx[i] = float(motion.x());  my[i] = float(motion.y());  mz[i] = float(motion.z());
+            radius_f[i] = float(radii[i]);
+
+            double size = 0;
+            for (int a = 0; a < 3; a++)
+                size = std::fmax(size, std::fmax(std::fabs(c0[a]), std::fabs(c0[a] + motion[a])));
+            extent[i] = float(size + radii[i]);
+        }
+    }
+
+    template <typename T>
+    static void permute(std::vector<T>& values, const std::vector<uint32_t>& order) {
+        std::vector<T> sorted;
+        sorted.reserve(order.size());
+        for (uint32_t id : order)
+            sorted.push_back(values[id]);
+        values.swap(sorted);
+    }
+
+    static int lowest_bit(int bits) {
+        int lane = 0;
+        while (!(bits & 1)) { bits >>= 1; lane++; }
+        return lane;
+    }
+
+    int candidate_mask(const ray_setup& rs, uint32_t first, const interval& ray_t) const {
+        // One SIMD pass over the spheres first, first + 1, ... of a leaf. A lane is set unless the
+        // float test shows, with room to spare, that sphere::hit would miss.
+        floatv ccx = floatv::load(&cx[first]);
+        floatv ccy = floatv::load(&cy[first]);
+        floatv ccz = floatv::load(&cz[first]);
+        if (has_motion) {
+            ccx = ccx + rs.time * floatv::load(&mx[first]);
+            ccy = ccy + rs.time * floatv::load(&my[first]);
+            ccz = ccz + rs.time * floatv::load(&mz[first]);
+        }
+        floatv r = floatv::load(&radius_f[first]);
+
+        floatv ocx = ccx - rs.ox, ocy = ccy - rs.oy, ocz = ccz - rs.oz;
+        floatv h = rs.dx*ocx + rs.dy*ocy + rs.dz*ocz;
+        floatv oc2 = ocx*ocx + ocy*ocy + ocz*ocz;
+        floatv r2 = r*r;
+        floatv discriminant = h*h - rs.a*(oc2 - r2);  // a * (r^2 - distance from centre to ray^2)
+
+        // Rounding the inputs to float moves the centre relative to the ray by at most delta, and
+        // the float arithmetic adds a few ulps of the largest terms; pad for both, generously.
+        floatv delta = floatv(1e-6f) * (rs.origin_size + floatv::load(&extent[first]));
+        floatv tolerance = rs.a * (floatv(2.0f)*r + delta) * delta
+                         + floatv(1e-5f) * (h*h + rs.a*(oc2 + r2));
+        maskv hits_line = discriminant >= floatv(0.0f) - tolerance;
+
+        // Both roots lie within r of the centre's projection onto the ray.
+        floatv reach = r * rs.length + delta * rs.length + floatv(1e-5f) * abs(h);
+        maskv in_range = (h + reach >= rs.a * floatv(float(ray_t.min)))
+                       & (h - reach <= rs.a * floatv(float(ray_t.max)));
+
+        return (hits_line & in_range).bits();
+    }
+
+    bool intersect_exact(const ray& r, uint32_t i, const interval& ray_t, real& root) const {
+        // sphere::hit, step for step.
+        RT_COUNT_TEST(sphere);
+        point3 current_center = centers[i].at(r.time());
+        vec3 oc = current_center - r.origin();
+        auto a = r.direction().length_squared();
+        auto b = -2 * dot(r.direction(), oc);
+        auto c = oc.length_squared() - radii[i]*radii[i];
+
+        auto discriminant = b*b - 4*a*c;
+        if (discriminant < 0)
+            return false;
+
+        auto sqrtd = std::sqrt(discriminant);
+
+        root = (- b - sqrtd) / (2*a);
+        if (!ray_t.surround(root)) {
+            root = (- b + sqrtd) / (2*a);
+            if (!ray_t.surround(root))
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
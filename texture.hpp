@@ -4,15 +4,22 @@
 #include "utilis.hpp"
 #include "perlin.hpp"
 #include "rtw_stb_image.hpp"
+#include "scalar_grid.hpp"
+#include <chrono>
+#include <variant>
 
 class texture {
   public : 
     virtual ~texture(){};
     virtual color value (double u , double v , const point3&p) const = 0;
+
+    // Whether value() reads u and v; textures that only use the point say no, so hits on them
+    // never compute UVs.
+    virtual bool uses_uv() const { return true; }
 };
 
 
-class solid_color : public texture {
+class solid_color final : public texture {
   public :
     solid_color(const color& albedo ) : albedo(albedo){}
 
@@ -21,13 +28,16 @@ class solid_color : public texture {
     color value (double u , double v, const point3&p) const override {
         return albedo;
     }
+
+    bool uses_uv() const override { return false; }
     
   private :
+    friend class texture_ref;
     color albedo ;
 };
 
 ///
-class checker_texture : public texture {
+class checker_texture final : public texture {
   public:
     checker_texture(double scale, shared_ptr<texture> even, shared_ptr<texture> odd)
       : inv_scale(1.0 / scale), even(even), odd(odd) {}
@@ -36,22 +46,27 @@ class checker_texture : public texture {
       : checker_texture(scale, make_shared<solid_color>(c1), make_shared<solid_color>(c2)) {}
 
     color value(double u, double v, const point3& p) const override {
+        return is_even(inv_scale, p) ? even->value(u, v, p) : odd->value(u, v, p);
+    }
+
+    bool uses_uv() const override { return even->uses_uv() || odd->uses_uv(); }
+
+    static bool is_even(double inv_scale, const point3& p) {
         auto xInteger = int(std::floor(inv_scale * p.x()));
         auto yInteger = int(std::floor(inv_scale * p.y()));
         auto zInteger = int(std::floor(inv_scale * p.z()));
 
-        bool isEven = (xInteger + yInteger + zInteger) % 2 == 0;
-
-        return isEven ? even->value(u, v, p) : odd->value(u, v, p);
+        return (xInteger + yInteger + zInteger) % 2 == 0;
     }
 
   private:
+    friend class texture_ref;
     double inv_scale;
     shared_ptr<texture> even;
     shared_ptr<texture> odd;
 };
 
-class image_texture : public texture {
+class image_texture final : public texture {
   public:
     image_texture(const char* filename ) : image(filename){}
     color value(double u, double v, const point3& p) const override {
@@ -79,15 +94,94 @@ class noise_texture : public texture {
 
     noise_texture(double freq) :freq(freq){}
 
+    void bake(const aabb& bounds, int resolution,
+              scalar_grid::filter mode = scalar_grid::filter::trilinear) {
+        // Precomputes the turbulence term over `bounds` (usually the bounding box of the object
+        // that wears this texture) so that value() becomes a grid lookup instead of seven octaves
+        // of Perlin noise. Points that fall outside the baked box still use the procedural path.
+        auto t_start = std::chrono::high_resolution_clock::now();
+
+        baked = scalar_grid(bounds, resolution);
+        baked.fill([this](const point3& p) { return noise.turb(p, turb_depth); });
+        filter = mode;
+        use_baked = true;
+
+        auto t_end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> diff = t_end - t_start;
+        std::clog << "noise_texture: baked " << baked.node_count() << " samples ("
+                  << baked.memory_bytes() / (1024.0 * 1024.0) << " MiB, "
+                  << (mode == scalar_grid::filter::tricubic ? "tricubic" : "trilinear")
+                  << ") in " << diff.count() << " seconds\n";
+    }
+
     color value(double u, double v, const point3& p) const override {
         // return color(1,1,1) * 0.5 * (noise.noise(freq * p) + 1);
         // return color(1,1,1) * noise.turb(p, 7);
-        return color(.5, .5, .5) * (1 + std::sin(freq * p.z() + 10 * noise.turb(p, 7)));
+        auto turbulence = (use_baked && baked.contains(p)) ? baked.sample(p, filter)
+                                                           : noise.turb(p, turb_depth);
+        return color(.5, .5, .5) * (1 + std::sin(freq * p.z() + 10 * turbulence));
     }
 
+    bool uses_uv() const override { return false; }
+
   private:
+    static const int turb_depth = 7;
     perlin noise;
     double freq;
+    bool use_baked = false;
+    scalar_grid baked;
+    scalar_grid::filter filter = scalar_grid::filter::trilinear;
+};
+
+// A texture slot held by value inside materials. The common cases (a constant colour, a checker
+// of two constant colours and an image) are stored inline and evaluated without a virtual call;
+// anything else is kept as a shared_ptr<texture> and goes through texture::value as before. The
+// inlined classes are final, so no subclass with its own value() is mistaken for one of them.
+class texture_ref {
+  public:
+    texture_ref(const color& albedo) : node(albedo) {}
+
+    texture_ref(shared_ptr<texture> tex) : node(tex) {
+        // Flatten the texture into one of the inline forms when we recognise it.
+        if (auto solid = std::dynamic_pointer_cast<solid_color>(tex)) {
+            node = solid->albedo;
+        } else if (auto checker = std::dynamic_pointer_cast<checker_texture>(tex)) {
+            auto even = std::dynamic_pointer_cast<solid_color>(checker->even);
+            auto odd  = std::dynamic_pointer_cast<solid_color>(checker->odd);
+            if (even && odd)
+                node = solid_checker{checker->inv_scale, even->albedo, odd->albedo};
+        } else if (auto image = std::dynamic_pointer_cast<image_texture>(tex)) {
+            node = shared_ptr<const image_texture>(image);
+        }
+    }
+
+    color value(double u, double v, const point3& p) const {
+        switch (node.index()) {
+            case 0: return *std::get_if<color>(&node);
+            case 1: {
+                auto& c = *std::get_if<solid_checker>(&node);
+                return checker_texture::is_even(c.inv_scale, p) ? c.even : c.odd;
+            }
+            case 2: return (*std::get_if<shared_ptr<const image_texture>>(&node))->value(u, v, p);
+            default: return (*std::get_if<shared_ptr<texture>>(&node))->value(u, v, p);
+        }
+    }
+
+    // Whether value() reads u and v. The inline constant and checker forms only use the point.
+    bool uses_uv() const {
+        if (auto tex = std::get_if<shared_ptr<texture>>(&node))
+            return (*tex)->uses_uv();
+        return node.index() == 2;
+    }
+
+  private:
+    struct solid_checker {
+        double inv_scale;
+        color even;
+        color odd;
+    };
+
+    std::variant<color, solid_checker, shared_ptr<const image_texture>, shared_ptr<texture>> node;
 };
 
 #endif 
\ No newline at end of file
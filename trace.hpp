@@ -0,0 +1,186 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// A timeline of the render phases, for looking at where the time goes and at the threads that
+// finish last. Built with -DRT_TRACE, each trace_span records its start and duration into a ring
+// buffer of the thread it runs on, once trace_log::start() has named an output file. At exit the
+// buffers are written there as Chrome trace_event JSON, which chrome://tracing and
+// ui.perfetto.dev open. The renderer calls start() if the RT_TRACE environment variable is set:
+//     RT_TRACE=out/trace.json build/main.exe 7
+//
+// A span costs one relaxed atomic load while tracing is off, and two clock reads and a store into
+// a thread-local buffer while it is on; nothing is locked except the first time a thread records.
+// Each thread keeps its newest ring_capacity spans and drops the oldest ones. Without -DRT_TRACE,
+// trace_span is empty and the calls compile to nothing.
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#ifdef RT_TRACE
+    #include <atomic>
+    #include <chrono>
+    #include <cstdlib>
+    #include <fstream>
+    #include <memory>
+    #include <mutex>
+    #include <vector>
+#endif
+
+#ifdef RT_TRACE
+
+class trace_log {
+  public:
+    static const size_t ring_capacity = 1 << 15;    // Spans kept per thread
+
+    // One finished span. Names are string literals, so only the pointer is kept.
+    struct event {
+        const char* name;
+        const char* category;
+        uint64_t start_ns, duration_ns;
+        int32_t x, y;               // Optional arguments, e.g. a tile's corner; -1 if unused
+    };
+
+    // Starts recording; the trace is written to `path` when the program exits.
+    static void start(const std::string& path) {
+        trace_log& log = instance();
+        std::lock_guard<std::mutex> lock(log.mutex);
+        log.path = path;
+        log.enabled_flag.store(true, std::memory_order_relaxed);
+        std::clog << "Tracing to " << path << "\n" << std::flush;
+    }
+
+    static bool enabled() {
+        return instance().enabled_flag.load(std::memory_order_relaxed);
+    }
+
+    static uint64_t now_ns() {
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - instance().epoch).count());
+    }
+
+    static void record(const event& e) {
+        ring*& r = thread_ring();
+        if (!r)
+            r = instance().add_ring();
+        r->events[r->count % ring_capacity] = e;
+        r->count++;
+    }
+
+    ~trace_log() {
+        if (enabled_flag.load(std::memory_order_relaxed))
+            write();
+    }
+
+  private:
+    struct ring {
+        std::vector<event> events = std::vector<event>(ring_capacity);
+        uint64_t count = 0;         // Spans recorded; the newest ring_capacity are kept
+        int tid;
+    };
+
+    std::atomic<bool> enabled_flag{false};
+    std::mutex mutex;
+    std::string path;
+    std::vector<std::unique_ptr<ring>> rings;   // Outlive their threads, for the dump at exit
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+    static trace_log& instance() {
+        static trace_log log;
+        return log;
+    }
+
+    static ring*& thread_ring() {
+        thread_local ring* r = nullptr;
+        return r;
+    }
+
+    ring* add_ring() {
+        std::lock_guard<std::mutex> lock(mutex);
+        rings.emplace_back(new ring);
+        rings.back()->tid = int(rings.size());
+        return rings.back().get();
+    }
+
+    void write() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::ofstream out(path);
+        if (!out) {
+            std::cerr << "ERROR: cannot write the trace to " << path << ".\n";
+            return;
+        }
+
+        out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        bool first = true;
+        uint64_t dropped = 0;
+        for (const auto& r : rings) {
+            out << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+                << "\"tid\": " << r->tid << ", \"args\": {\"name\": \"thread " << r->tid << "\"}}";
+            first = false;
+
+            uint64_t begin = r->count > ring_capacity ? r->count - ring_capacity : 0;
+            dropped += begin;
+            for (uint64_t k = begin; k < r->count; k++) {
+                const event& e = r->events[k % ring_capacity];
+                out << ",\n{\"name\": \"" << e.name << "\", \"cat\": \"" << e.category
+                    << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << r->tid
+                    << ", \"ts\": " << e.start_ns * 1e-3 << ", \"dur\": " << e.duration_ns * 1e-3;
+                if (e.x >= 0)
+                    out << ", \"args\": {\"x\": " << e.x << ", \"y\": " << e.y << "}";
+                out << "}";
+            }
+        }
+        out << "\n]}\n";
+        if (dropped)
+            std::clog << "Trace: the oldest " << dropped << " spans did not fit and were dropped\n";
+        std::clog << "Trace written to " << path << "\n" << std::flush;
+    }
+};
+
+// Records the time from its construction to end() or its destruction as one span, if tracing is
+// on and `name` is not null.
+class trace_span {
+  public:
+    explicit trace_span(const char* name, const char* category = "render", int x = -1, int y = -1)
+      : name(trace_log::enabled() ? name : nullptr), category(category), x(x), y(y),
+        start_ns(this->name ? trace_log::now_ns() : 0) {}
+
+    ~trace_span() { end(); }
+
+    trace_span(const trace_span&) = delete;
+    trace_span& operator=(const trace_span&) = delete;
+
+    void end() {
+        if (!name)
+            return;
+        trace_log::record({ name, category, start_ns, trace_log::now_ns() - start_ns,
+                            int32_t(x), int32_t(y) });
+        name = nullptr;
+    }
+
+  private:
+    const char* name;
+    const char* category;
+    int x, y;
+    uint64_t start_ns;
+};
+
+#else
+
+class trace_log {
+  public:
+    static void start(const std::string&) {
+        std::cerr << "ERROR: this build has no tracing; rebuild with -DRT_TRACE.\n";
+    }
+    static bool enabled() { return false; }
+};
+
+class trace_span {
+  public:
+    explicit trace_span(const char*, const char* = "render", int = -1, int = -1) {}
+    void end() {}
+};
+
+#endif
+
+#endif
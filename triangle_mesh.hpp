@@ -0,0 +1,222 @@
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include "hittable.hpp"
+#include "flat_bvh.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Vertex and index data for an indexed triangle mesh, kept as structure-of-arrays so that a mesh
+// with millions of faces costs a few flat allocations instead of one object per face. Normals and
+// texture coordinates are optional: leave those arrays empty if the source has none.
+class mesh_data {
+  public:
+    std::vector<float> px, py, pz;      // Vertex positions
+    std::vector<float> nx, ny, nz;      // Per-vertex shading normals (optional)
+    std::vector<float> tu, tv;          // Per-vertex texture coordinates (optional)
+    std::vector<uint32_t> indices;      // Three vertex indices per triangle
+
+    uint32_t add_vertex(const point3& p) {
+        px.push_back(float(p.x()));
+        py.push_back(float(p.y()));
+        pz.push_back(float(p.z()));
+        return uint32_t(px.size() - 1);
+    }
+
+    void add_triangle(uint32_t a, uint32_t b, uint32_t c) {
+        indices.push_back(a);
+        indices.push_back(b);
+        indices.push_back(c);
+    }
+
+    size_t vertex_count() const { return px.size(); }
+    size_t triangle_count() const { return indices.size() / 3; }
+    bool has_normals() const { return !nx.empty(); }
+    bool has_uvs() const { return !tu.empty(); }
+
+    point3 position(uint32_t i) const { return point3(px[i], py[i], pz[i]); }
+    vec3 normal(uint32_t i) const { return vec3(nx[i], ny[i], nz[i]); }
+
+    size_t memory_bytes() const {
+        return (px.capacity() + py.capacity() + pz.capacity()
+              + nx.capacity() + ny.capacity() + nz.capacity()
+              + tu.capacity() + tv.capacity()) * sizeof(float)
+              + indices.capacity() * sizeof(uint32_t);
+    }
+};
+
+// A triangle mesh hittable with its own flat_bvh over the triangles, so the whole mesh is a single
+// hittable no matter how many faces it has.
+class triangle_mesh : public hittable {
+  public:
+    triangle_mesh(shared_ptr<const mesh_data> mesh, shared_ptr<material> mat)
+      : mesh(mesh), mat(mat)
+    {
+        build_bvh();
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return intersect_and_finish(r, ray_t, rec);
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        const ray_setup rs(r);
+        uint32_t hit_tri = 0;
+        double hit_b1 = 0, hit_b2 = 0;
+
+        bool hit_anything = bvh.traverse(r, ray_t, [&](uint32_t tri, interval& t_range) {
+            double t, b1, b2;
+            if (!intersect_triangle(rs, tri, t_range, t, b1, b2))
+                return false;
+            t_range.max = t;
+            hit_tri = tri;
+            hit_b1 = b1;
+            hit_b2 = b2;
+            return true;
+        });
+
+        if (!hit_anything)
+            return false;
+
+        rec.t = ray_t.max;
+        rec.prim = hit_tri;
+        rec.b1 = hit_b1;
+        rec.b2 = hit_b2;
+        rec.pending = this;
+        return true;
+    }
+
+    void finish_hit(const ray& r, hit_record& rec) const override {
+        fill_hit_record(r, rec.prim, rec.t, rec.b1, rec.b2, rec);
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    size_t memory_bytes() const {
+        // Bytes owned by this mesh, including the shared vertex/index data.
+        return mesh->memory_bytes() + bvh.memory_bytes();
+    }
+
+    size_t triangle_count() const { return mesh->triangle_count(); }
+
+  private:
+    // Per-ray values for the triangle test, computed once per hit() call.
+    struct ray_setup {
+        point3 origin;
+        int kx, ky, kz;                 // Axis permutation for the watertight triangle test
+        double sx, sy, sz;              // Shear constants for the watertight triangle test
+
+        ray_setup(const ray& r) : origin(r.origin()) {
+            const vec3& d = r.direction();
+            kz = (std::fabs(d.x()) > std::fabs(d.y()))
+                     ? (std::fabs(d.x()) > std::fabs(d.z()) ? 0 : 2)
+                     : (std::fabs(d.y()) > std::fabs(d.z()) ? 1 : 2);
+            kx = (kz + 1) % 3;
+            ky = (kx + 1) % 3;
+            if (d[kz] < 0) std::swap(kx, ky);
+
+            sx = d[kx] / d[kz];
+            sy = d[ky] / d[kz];
+            sz = 1.0 / d[kz];
+        }
+    };
+
+    shared_ptr<const mesh_data> mesh;
+    shared_ptr<material> mat;
+    flat_bvh bvh;
+    aabb bbox;
+
+    static const int max_leaf_size = 4;
+
+    bool intersect_triangle(const ray_setup& rs, uint32_t tri, const interval& ray_t,
+                            double& t, double& b1, double& b2) const {
+        // Watertight ray/triangle intersection (Woop, Benthin and Wald, JCGT 2013). The triangle
+        // is translated to the ray origin and sheared so the ray points down +Z; edges shared by
+        // two triangles then produce exactly the same edge function, so no ray slips through.
+        RT_COUNT_TEST(triangle);
+        const uint32_t* v = &mesh->indices[size_t(tri) * 3];
+        vec3 A = mesh->position(v[0]) - rs.origin;
+        vec3 B = mesh->position(v[1]) - rs.origin;
+        vec3 C = mesh->position(v[2]) - rs.origin;
+
+        double ax = A[rs.kx] - rs.sx * A[rs.kz];
+        double ay = A[rs.ky] - rs.sy * A[rs.kz];
+        double bx = B[rs.kx] - rs.sx * B[rs.kz];
+        double by = B[rs.ky] - rs.sy * B[rs.kz];
+        double cx = C[rs.kx] - rs.sx * C[rs.kz];
+        double cy = C[rs.ky] - rs.sy * C[rs.kz];
+
+        double U = cx*by - cy*bx;
+        double V = ax*cy - ay*cx;
+        double W = bx*ay - by*ax;
+
+        if ((U < 0 || V < 0 || W < 0) && (U > 0 || V > 0 || W > 0))
+            return false;
+
+        double det = U + V + W;
+        if (det == 0)
+            return false;
+
+        double T = U * (rs.sz * A[rs.kz]) + V * (rs.sz * B[rs.kz]) + W * (rs.sz * C[rs.kz]);
+        t = T / det;
+        if (!ray_t.surround(t))
+            return false;
+
+        b1 = V / det;
+        b2 = W / det;
+        return true;
+    }
+
+    void fill_hit_record(const ray& r, uint32_t tri, double t, double b1, double b2,
+                         hit_record& rec) const {
+        const uint32_t* v = &mesh->indices[size_t(tri) * 3];
+        double b0 = 1 - b1 - b2;
+
+        point3 p0 = mesh->position(v[0]);
+        point3 p1 = mesh->position(v[1]);
+        point3 p2 = mesh->position(v[2]);
+        vec3 geometric_normal = unit_vector(cross(p1 - p0, p2 - p0));
+
+        rec.t = t;
+        rec.p = r.at(t);
+        rec.mat = mat;
+        rec.set_face_normal(r, geometric_normal);
+
+        if (mesh->has_normals()) {
+            // Interpolated shading normal, kept on the same side as the geometric normal.
+            // Degenerate (e.g. missing) normals leave the geometric normal in place.
+            vec3 n = b0 * mesh->normal(v[0]) + b1 * mesh->normal(v[1]) + b2 * mesh->normal(v[2]);
+            if (n.length_squared() > 0) {
+                n = unit_vector(n);
+                rec.normal = dot(n, rec.normal) < 0 ? -n : n;
+            }
+        }
+
+        if (mesh->has_uvs()) {
+            rec.u = b0 * mesh->tu[v[0]] + b1 * mesh->tu[v[1]] + b2 * mesh->tu[v[2]];
+            rec.v = b0 * mesh->tv[v[0]] + b1 * mesh->tv[v[1]] + b2 * mesh->tv[v[2]];
+        } else {
+            rec.u = b1;
+            rec.v = b2;
+        }
+        rec.deferred_uv = nullptr;
+    }
+
+    void build_bvh() {
+        size_t n = mesh->triangle_count();
+        std::vector<flat_bvh::bounds3> tri_bounds(n);
+        for (size_t tri = 0; tri < n; tri++) {
+            for (int k = 0; k < 3; k++) {
+                uint32_t v = mesh->indices[tri * 3 + k];
+                float p[3] = { mesh->px[v], mesh->py[v], mesh->pz[v] };
+                tri_bounds[tri].grow(p);
+            }
+        }
+
+        bvh = flat_bvh(tri_bounds, max_leaf_size);
+        bbox = bvh.bounding_box();
+    }
+};
+
+#endif
@@ -6,6 +6,16 @@
 #include <iostream>
 #include <limits>
 #include <memory>
+
+// Scalar type of the geometry: vec3, ray, interval and aabb, and so also point3 and color. Double
+// by default; build with -DRT_FLOAT for single precision, which halves the size of every vector
+// and lets SIMD code fit twice as many values per register.
+#ifdef RT_FLOAT
+    using real = float;
+#else
+    using real = double;
+#endif
+
 #include "interval.hpp"
 
 // C++ Std Usings
@@ -52,6 +62,7 @@ inline double random_double_mt() {
 
 // Common Headers
 
+#include "sampler.hpp"
 #include "color.hpp"
 #include "ray.hpp"
 #include "vec3.hpp"
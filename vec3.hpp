@@ -5,134 +5,209 @@
 #include <cmath>
 #include <cstdlib>
 #include <iostream>
+#include <limits>
 #include <random>
+#include "fast_math.hpp"
 
 
-class vec3 {
+// With -DRT_SIMD_VEC3, vec3_simd.hpp implements the common operations on vec3_t<float> (with SSE2)
+// and vec3_t<double> (with AVX2) in SIMD registers. Those types then store a fourth, always-zero
+// component and are aligned so that a vector loads as one register.
+#if defined(RT_SIMD_VEC3) && defined(__SSE2__)
+    #define RT_SIMD_VEC3_FLOAT
+#endif
+#if defined(RT_SIMD_VEC3) && defined(__AVX2__)
+    #define RT_SIMD_VEC3_DOUBLE
+#endif
+
+template <typename T> struct vec3_layout { static constexpr int lanes = 3; };
+#ifdef RT_SIMD_VEC3_FLOAT
+    template <> struct vec3_layout<float> { static constexpr int lanes = 4; };
+#endif
+#ifdef RT_SIMD_VEC3_DOUBLE
+    template <> struct vec3_layout<double> { static constexpr int lanes = 4; };
+#endif
+
+// Three components of scalar type T. The renderer uses vec3 = vec3_t<real> (see utilis.hpp);
+// the other precision is available for validation, e.g. vec3_t<double>(v) in a float build.
+template <typename T>
+class vec3_t {
 public :
-    double e[3];
+    static constexpr int lanes = vec3_layout<T>::lanes;
+    alignas(lanes == 4 ? 4 * sizeof(T) : alignof(T)) T e[lanes];
 
     // constructor
-    vec3() : e{0,0,0}{}
-    vec3(double e0, double e1, double e2) : e{e0, e1, e2}{}
+    vec3_t() : e{0,0,0}{}
+    vec3_t(T e0, T e1, T e2) : e{e0, e1, e2}{}
+
+    template <typename U>
+    explicit vec3_t(const vec3_t<U>& v) : e{T(v.e[0]), T(v.e[1]), T(v.e[2])} {}
 
 
-    double x() const { return e[0]; } // v.x()
-    double y() const { return e[1]; }
-    double z() const { return e[2]; }
+    T x() const { return e[0]; } // v.x()
+    T y() const { return e[1]; }
+    T z() const { return e[2]; }
 
-    vec3 operator-() const {return vec3(-e[0], -e[1], -e[2]);}
-    double operator[](int i) const { return e[i]; }
-    double& operator[](int i) { return e[i]; }
+    vec3_t operator-() const {return vec3_t(-e[0], -e[1], -e[2]);}
+    T operator[](int i) const { return e[i]; }
+    T& operator[](int i) { return e[i]; }
 
-    vec3& operator += (const vec3& v){
+    vec3_t& operator += (const vec3_t& v){
         e[0] += v.e[0];
         e[1] += v.e[1];
         e[2] += v.e[2];
         return *this;
     }
 
-    vec3& operator -= (const vec3& v){   // vector u - v => v points to u
+    vec3_t& operator -= (const vec3_t& v){   // vector u - v => v points to u
         e[0] -= v.e[0];
         e[1] -= v.e[1];
         e[2] -= v.e[2];
         return *this;
     }
 
-    vec3& operator*=(double t) { //
+    vec3_t& operator*=(T t) { //
         e[0] *= t;
         e[1] *= t;
         e[2] *= t;
         return *this;
     }
 
-    vec3& operator/=(double t) {
+    vec3_t& operator/=(T t) {
         return *this *= 1/t;
     }
 
-    double length() const {
+    T length() const {
         return std::sqrt(length_squared());
     }
 
-    double length_squared() const {
+    T length_squared() const {
         return e[0]*e[0] + e[1]*e[1] + e[2]*e[2];
     }
 
     bool near_zero() const {
         // Return true if the vector is close to zero in all dimensions.
-        auto s = 1e-8;
+        auto s = T(1e-8);
         return (std::fabs(e[0]) < s)
                 && (std::fabs(e[1]) < s) 
                 && (std::fabs(e[2]) < s);
     }
 
-    static vec3 random() {
-        return vec3(random_double(), random_double(), random_double());
+    static vec3_t random() {
+        return vec3_t(random_double(), random_double(), random_double());
     }
 
-    static vec3 random(double min, double max) {
-        return vec3(random_double(min,max), random_double(min,max), random_double(min,max));
+    static vec3_t random(double min, double max) {
+        return vec3_t(random_double(min,max), random_double(min,max), random_double(min,max));
     }
 };
 
+// Scalars mixed with vec3_t<T> are converted to T rather than taking part in deduction, so that
+// 2 * v or 0.5 * v work for either precision.
+template <typename T> struct scalar_of { using type = T; };
+template <typename T> using scalar_t = typename scalar_of<T>::type;
+
+using vec3 = vec3_t<real>;
 
 // point3 is just an alias for vec3, but useful for geometric clarity in the code.
 using point3 = vec3;
-inline std::ostream& operator<<(std::ostream& out, const vec3& v) {
+template <typename T>
+inline std::ostream& operator<<(std::ostream& out, const vec3_t<T>& v) {
     return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
 }
 
-inline vec3 operator+(const vec3& u, const vec3& v) {
-    return vec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
+template <typename T>
+inline vec3_t<T> operator+(const vec3_t<T>& u, const vec3_t<T>& v) {
+    return vec3_t<T>(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
 } // c = a + b 
 
 
-inline vec3 operator-(const vec3& u, const vec3& v) {
-    return vec3(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
+template <typename T>
+inline vec3_t<T> operator-(const vec3_t<T>& u, const vec3_t<T>& v) {
+    return vec3_t<T>(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
 } // c = a - b 
 
-inline vec3 operator*(const vec3& u, const vec3& v) {
-    return vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
+template <typename T>
+inline vec3_t<T> operator*(const vec3_t<T>& u, const vec3_t<T>& v) {
+    return vec3_t<T>(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
 } // c = a * b 
 
-inline vec3 operator*(double t, const vec3& v) {
-    return vec3(t*v.e[0], t*v.e[1], t*v.e[2]);
+template <typename T>
+inline vec3_t<T> operator*(scalar_t<T> t, const vec3_t<T>& v) {
+    return vec3_t<T>(t*v.e[0], t*v.e[1], t*v.e[2]);
 }
 
-inline vec3 operator*(const vec3& v, double t) {
+template <typename T>
+inline vec3_t<T> operator*(const vec3_t<T>& v, scalar_t<T> t) {
     return t * v;
 }
-inline vec3 operator/(const vec3& v, double t) {
+template <typename T>
+inline vec3_t<T> operator/(const vec3_t<T>& v, scalar_t<T> t) {
     return (1/t) * v;
 }
 
-inline double dot(const vec3& u, const vec3& v) {
+template <typename T>
+inline T dot(const vec3_t<T>& u, const vec3_t<T>& v) {
     return u.e[0] * v.e[0]
          + u.e[1] * v.e[1]
          + u.e[2] * v.e[2];
 }
 
 
-inline vec3 cross(const vec3& u, const vec3& v) {
-    return vec3(u.e[1] * v.e[2] - u.e[2] * v.e[1],
-                u.e[2] * v.e[0] - u.e[0] * v.e[2],
-                u.e[0] * v.e[1] - u.e[1] * v.e[0]);
+template <typename T>
+inline vec3_t<T> cross(const vec3_t<T>& u, const vec3_t<T>& v) {
+    return vec3_t<T>(u.e[1] * v.e[2] - u.e[2] * v.e[1],
+                     u.e[2] * v.e[0] - u.e[0] * v.e[2],
+                     u.e[0] * v.e[1] - u.e[1] * v.e[0]);
 }
 
-inline vec3 unit_vector(const vec3& v) {
+template <typename T>
+inline vec3_t<T> unit_vector(const vec3_t<T>& v) {
     return v / v.length();
 }
 
+#ifdef RT_SIMD_VEC3
+    #include "vec3_simd.hpp"
+#endif
+
+// The random_* directions below draw from sample_1d(), so they follow the camera's sampler when
+// it has one. Rejection sampling would use a varying number of its dimensions, so with a sampler
+// they map exactly two values instead.
+
 inline vec3 random_unit_vector() {
+    if (sampler_active()) {
+        // Uniform on the sphere: z uniform in [-1, 1], the angle around z uniform.
+        double z = 1 - 2 * sample_1d();
+        double r = std::sqrt(std::fmax(0.0, 1 - z*z)), sin_phi, cos_phi;
+        fast_sincos(2 * pi * sample_1d(), sin_phi, cos_phi);
+        return vec3(r * cos_phi, r * sin_phi, z);
+    }
     while (true) {
         auto p = vec3::random(-1,1);
         auto lensq = p.length_squared();
-        if (1e-160 < lensq && lensq <= 1)
+        if (std::numeric_limits<real>::min() < lensq && lensq <= 1)
             return p / sqrt(lensq);
     }
 }
 
 inline vec3 random_in_unit_disk() {
+    if (sampler_active()) {
+        // Shirley and Chiu's concentric map from the square, which keeps strata compact.
+        double a = 2 * sample_1d() - 1;
+        double b = 2 * sample_1d() - 1;
+        if (a == 0 && b == 0)
+            return vec3(0, 0, 0);
+        double r, phi, sin_phi, cos_phi;
+        if (std::fabs(a) > std::fabs(b)) {
+            r = a;
+            phi = (pi / 4) * (b / a);
+        } else {
+            r = b;
+            phi = (pi / 2) - (pi / 4) * (a / b);
+        }
+        fast_sincos(phi, sin_phi, cos_phi);
+        return vec3(r * cos_phi, r * sin_phi, 0);
+    }
     while (true) {
         auto p = vec3(random_double(-1,1), random_double(-1,1), 0);
         if (p.length_squared() < 1)
@@ -166,12 +241,13 @@ inline vec3 refract(const vec3& uv, const vec3& n, double etai_over_etat) {
 
 
 inline vec3 random_cosine_direction() {
-    auto r1 = random_double();
-    auto r2 = random_double();
+    auto r1 = sample_1d();
+    auto r2 = sample_1d();
 
-    auto phi = 2*pi*r1;
-    auto x = std::cos(phi) * std::sqrt(r2);
-    auto y = std::sin(phi) * std::sqrt(r2);
+    double phi = 2*pi*r1, sin_phi, cos_phi;
+    fast_sincos(phi, sin_phi, cos_phi);
+    auto x = cos_phi * std::sqrt(r2);
+    auto y = sin_phi * std::sqrt(r2);
     auto z = std::sqrt(1-r2);
 
     return vec3(x, y, z);
@@ -0,0 +1,186 @@
+#ifndef VEC3_SIMD_H
+#define VEC3_SIMD_H
+
+// SIMD versions of the vec3_t operations that dominate the hit tests and scattering code, for
+// builds with -DRT_SIMD_VEC3. They replace the scalar templates of vec3.hpp by overload (or, for
+// members, explicit specialization), so code using vec3 does not change.
+//
+// Each operation does exactly the per-component arithmetic of the scalar version, and dot() adds
+// the products in the same order, (x + y) + z, so results match the scalar build (up to the fused
+// multiply-adds the compiler may form in either one).
+
+#include <immintrin.h>
+
+#ifdef RT_SIMD_VEC3_FLOAT
+
+namespace vec3_simd {
+    inline __m128 load(const vec3_t<float>& v) { return _mm_load_ps(v.e); }
+
+    inline vec3_t<float> store(__m128 x) {
+        vec3_t<float> v;
+        _mm_store_ps(v.e, x);
+        return v;
+    }
+
+    inline __m128 yzx(__m128 x) { return _mm_shuffle_ps(x, x, _MM_SHUFFLE(3, 0, 2, 1)); }
+
+    inline float sum3(__m128 x) {
+        __m128 sum = _mm_add_ss(x, _mm_shuffle_ps(x, x, _MM_SHUFFLE(1, 1, 1, 1)));
+        return _mm_cvtss_f32(_mm_add_ss(sum, _mm_movehl_ps(x, x)));
+    }
+}
+
+template <>
+inline vec3_t<float> vec3_t<float>::operator-() const {
+    return vec3_simd::store(_mm_xor_ps(vec3_simd::load(*this), _mm_set1_ps(-0.0f)));
+}
+
+template <>
+inline vec3_t<float>& vec3_t<float>::operator+=(const vec3_t<float>& v) {
+    _mm_store_ps(e, _mm_add_ps(vec3_simd::load(*this), vec3_simd::load(v)));
+    return *this;
+}
+
+template <>
+inline vec3_t<float>& vec3_t<float>::operator-=(const vec3_t<float>& v) {
+    _mm_store_ps(e, _mm_sub_ps(vec3_simd::load(*this), vec3_simd::load(v)));
+    return *this;
+}
+
+template <>
+inline vec3_t<float>& vec3_t<float>::operator*=(float t) {
+    _mm_store_ps(e, _mm_mul_ps(vec3_simd::load(*this), _mm_set1_ps(t)));
+    return *this;
+}
+
+template <>
+inline float vec3_t<float>::length_squared() const {
+    __m128 x = vec3_simd::load(*this);
+    return vec3_simd::sum3(_mm_mul_ps(x, x));
+}
+
+inline vec3_t<float> operator+(const vec3_t<float>& u, const vec3_t<float>& v) {
+    return vec3_simd::store(_mm_add_ps(vec3_simd::load(u), vec3_simd::load(v)));
+}
+
+inline vec3_t<float> operator-(const vec3_t<float>& u, const vec3_t<float>& v) {
+    return vec3_simd::store(_mm_sub_ps(vec3_simd::load(u), vec3_simd::load(v)));
+}
+
+inline vec3_t<float> operator*(const vec3_t<float>& u, const vec3_t<float>& v) {
+    return vec3_simd::store(_mm_mul_ps(vec3_simd::load(u), vec3_simd::load(v)));
+}
+
+inline vec3_t<float> operator*(float t, const vec3_t<float>& v) {
+    return vec3_simd::store(_mm_mul_ps(_mm_set1_ps(t), vec3_simd::load(v)));
+}
+
+inline vec3_t<float> operator*(const vec3_t<float>& v, float t) {
+    return t * v;
+}
+
+inline vec3_t<float> operator/(const vec3_t<float>& v, float t) {
+    return (1/t) * v;
+}
+
+inline float dot(const vec3_t<float>& u, const vec3_t<float>& v) {
+    return vec3_simd::sum3(_mm_mul_ps(vec3_simd::load(u), vec3_simd::load(v)));
+}
+
+inline vec3_t<float> cross(const vec3_t<float>& u, const vec3_t<float>& v) {
+    // u * v.yzx - u.yzx * v is the cross product rotated by one lane (z, x, y); rotate it back.
+    __m128 a = vec3_simd::load(u), b = vec3_simd::load(v);
+    __m128 c = _mm_sub_ps(_mm_mul_ps(a, vec3_simd::yzx(b)), _mm_mul_ps(vec3_simd::yzx(a), b));
+    return vec3_simd::store(vec3_simd::yzx(c));
+}
+
+#endif // RT_SIMD_VEC3_FLOAT
+
+#ifdef RT_SIMD_VEC3_DOUBLE
+
+namespace vec3_simd {
+    inline __m256d load(const vec3_t<double>& v) { return _mm256_load_pd(v.e); }
+
+    inline vec3_t<double> store(__m256d x) {
+        vec3_t<double> v;
+        _mm256_store_pd(v.e, x);
+        return v;
+    }
+
+    inline __m256d yzx(__m256d x) { return _mm256_permute4x64_pd(x, _MM_SHUFFLE(3, 0, 2, 1)); }
+
+    inline double sum3(__m256d x) {
+        __m128d xy = _mm256_castpd256_pd128(x);
+        __m128d sum = _mm_add_sd(xy, _mm_unpackhi_pd(xy, xy));
+        return _mm_cvtsd_f64(_mm_add_sd(sum, _mm256_extractf128_pd(x, 1)));
+    }
+}
+
+template <>
+inline vec3_t<double> vec3_t<double>::operator-() const {
+    return vec3_simd::store(_mm256_xor_pd(vec3_simd::load(*this), _mm256_set1_pd(-0.0)));
+}
+
+template <>
+inline vec3_t<double>& vec3_t<double>::operator+=(const vec3_t<double>& v) {
+    _mm256_store_pd(e, _mm256_add_pd(vec3_simd::load(*this), vec3_simd::load(v)));
+    return *this;
+}
+
+template <>
+inline vec3_t<double>& vec3_t<double>::operator-=(const vec3_t<double>& v) {
+    _mm256_store_pd(e, _mm256_sub_pd(vec3_simd::load(*this), vec3_simd::load(v)));
+    return *this;
+}
+
+template <>
+inline vec3_t<double>& vec3_t<double>::operator*=(double t) {
+    _mm256_store_pd(e, _mm256_mul_pd(vec3_simd::load(*this), _mm256_set1_pd(t)));
+    return *this;
+}
+
+template <>
+inline double vec3_t<double>::length_squared() const {
+    __m256d x = vec3_simd::load(*this);
+    return vec3_simd::sum3(_mm256_mul_pd(x, x));
+}
+
+inline vec3_t<double> operator+(const vec3_t<double>& u, const vec3_t<double>& v) {
+    return vec3_simd::store(_mm256_add_pd(vec3_simd::load(u), vec3_simd::load(v)));
+}
+
+inline vec3_t<double> operator-(const vec3_t<double>& u, const vec3_t<double>& v) {
+    return vec3_simd::store(_mm256_sub_pd(vec3_simd::load(u), vec3_simd::load(v)));
+}
+
+inline vec3_t<double> operator*(const vec3_t<double>& u, const vec3_t<double>& v) {
+    return vec3_simd::store(_mm256_mul_pd(vec3_simd::load(u), vec3_simd::load(v)));
+}
+
+inline vec3_t<double> operator*(double t, const vec3_t<double>& v) {
+    return vec3_simd::store(_mm256_mul_pd(_mm256_set1_pd(t), vec3_simd::load(v)));
+}
+
+inline vec3_t<double> operator*(const vec3_t<double>& v, double t) {
+    return t * v;
+}
+
+inline vec3_t<double> operator/(const vec3_t<double>& v, double t) {
+    return (1/t) * v;
+}
+
+inline double dot(const vec3_t<double>& u, const vec3_t<double>& v) {
+    return vec3_simd::sum3(_mm256_mul_pd(vec3_simd::load(u), vec3_simd::load(v)));
+}
+
+inline vec3_t<double> cross(const vec3_t<double>& u, const vec3_t<double>& v) {
+    // As the float version.
+    __m256d a = vec3_simd::load(u), b = vec3_simd::load(v);
+    __m256d c = _mm256_sub_pd(_mm256_mul_pd(a, vec3_simd::yzx(b)),
+                              _mm256_mul_pd(vec3_simd::yzx(a), b));
+    return vec3_simd::store(vec3_simd::yzx(c));
+}
+
+#endif // RT_SIMD_VEC3_DOUBLE
+
+#endif